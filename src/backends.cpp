@@ -0,0 +1,137 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <stdexcept>
+
+#include "utils/ThreadPool.hpp"
+#include "cpu/planar_cpu.hpp"
+#include "cpu/water_cpu.hpp"
+
+#ifdef USE_CUDA
+#include "students/water_cuda.hpp"
+#endif
+
+#include "backends.hpp"
+
+/// @brief Number of pixels from which the multithreaded CPU backend outperforms the single-threaded one.
+static const size_t cpu_mt_min_pixels = 256 * 256;
+
+/// @brief Return a thread pool that executes everything on the calling thread.
+static ThreadPool *serialPool() {
+  static ThreadPool pool(1);
+  return &pool;
+}
+
+/// @brief Return the registry, holding the built-in backends on first use.
+static std::deque<Backend> &registry() {
+  // A deque never moves its elements when it grows, so pointers handed out by findBackend() stay valid.
+  static std::deque<Backend> backends{
+      {"baseline", "Baseline reference implementation.",
+       [](const Image *src, const WaterEffectOptions *options) { return runWaterEffect(src, options); },
+       nullptr,
+       nullptr},
+      {"cpu-scalar", "Optimized CPU implementation without SIMD, single-threaded.",
+       [](const Image *src, const WaterEffectOptions *options) {
+         return runWaterEffectCPU(src, options, SimdLevel::Scalar, serialPool());
+       },
+       nullptr,
+       [](const Image *src, const WaterEffectOptions *options, Image *dest) {
+         return runWaterEffectCPU(src, options, SimdLevel::Scalar, serialPool(), dest);
+       }},
+      {"cpu-simd", "Optimized CPU implementation with SIMD, single-threaded.",
+       [](const Image *src, const WaterEffectOptions *options) {
+         return runWaterEffectCPU(src, options, detectSimdLevel(), serialPool());
+       },
+       [](unsigned int, unsigned int) { return 1; },
+       [](const Image *src, const WaterEffectOptions *options, Image *dest) {
+         return runWaterEffectCPU(src, options, detectSimdLevel(), serialPool(), dest);
+       }},
+      {"cpu-mt", "Optimized CPU implementation with SIMD, multithreaded over tiles.",
+       [](const Image *src, const WaterEffectOptions *options) {
+         return runWaterEffectCPU(src, options, detectSimdLevel(), &ThreadPool::instance());
+       },
+       [](unsigned int width, unsigned int height) {
+         return (((size_t) width * height >= cpu_mt_min_pixels) && (ThreadPool::instance().size() > 1)) ? 2 : 0;
+       },
+       [](const Image *src, const WaterEffectOptions *options, Image *dest) {
+         return runWaterEffectCPU(src, options, detectSimdLevel(), &ThreadPool::instance(), dest);
+       }},
+      {"cpu-planar", "Optimized CPU implementation on planar images, multithreaded.",
+       [](const Image *src, const WaterEffectOptions *options) {
+         return runWaterEffectPlanar(src, options, detectSimdLevel(), &ThreadPool::instance());
+       },
+       nullptr,
+       nullptr},
+#ifdef USE_CUDA
+      // The CUDA pipeline is left to the students and may not produce an image, so it is only selected by name.
+      {"cuda", "CUDA implementation.",
+       [](const Image *src, const WaterEffectOptions *options) { return runWaterEffectCUDA(src, options); },
+       nullptr,
+       nullptr},
+#endif
+  };
+  return backends;
+}
+
+void registerBackend(const Backend &backend) {
+  if (findBackend(backend.name) != nullptr) {
+    throw std::runtime_error("Backend " + backend.name + " is already registered.");
+  }
+  registry().push_back(backend);
+}
+
+const std::deque<Backend> &getBackends() {
+  return registry();
+}
+
+const Backend *findBackend(const std::string &name) {
+  for (const auto &b : registry()) {
+    if (b.name == name) {
+      return &b;
+    }
+  }
+  return nullptr;
+}
+
+const Backend *selectBackend(unsigned int width, unsigned int height) {
+  const Backend *best = nullptr;
+  int best_score = 0;
+  for (const auto &b : registry()) {
+    int score = b.score ? b.score(width, height) : 0;
+    if (score > best_score) {
+      best = &b;
+      best_score = score;
+    }
+  }
+  if (best == nullptr) {
+    throw std::runtime_error("No backend is suitable for automatic selection.");
+  }
+  return best;
+}
+
+bool runBackendInto(const Backend &backend, const Image *src, const WaterEffectOptions *options, Image *dest) {
+  if ((dest->width != src->width) || (dest->height != src->height)) {
+    throw std::domain_error("Destination image must have the dimensions of the source image.");
+  }
+  if (backend.run_into) {
+    return backend.run_into(src, options, dest) != nullptr;
+  }
+  auto result = backend.run(src, options);
+  if (result == nullptr) {
+    return false;
+  }
+  std::memcpy(dest->data(), result->data(), dest->bytes());
+  return true;
+}
@@ -0,0 +1,82 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "utils/Image.hpp"
+#include "baseline/water.hpp"
+
+/// @brief An implementation of the water effect pipeline.
+struct Backend {
+  /// @brief Function running the whole pipeline on an image.
+  using Function = std::function<std::shared_ptr<Image>(const Image *, const WaterEffectOptions *)>;
+
+  /// @brief Function rating how well suited a backend is for images of some width and height.
+  using Score = std::function<int(unsigned int, unsigned int)>;
+
+  /// @brief Unique name to select this backend with.
+  std::string name;
+
+  /// @brief Human readable description.
+  std::string description;
+
+  /// @brief The pipeline implementation.
+  Function run;
+
+  /// @brief Automatic selection picks the backend with the highest positive score. If not set, it is never picked.
+  Score score;
+
+  /// @brief Function running the whole pipeline on an image, with the result going into another image.
+  using IntoFunction = std::function<std::shared_ptr<Image>(const Image *, const WaterEffectOptions *, Image *)>;
+
+  /// @brief Optional pipeline implementation that writes its result directly into a given image. See runBackendInto().
+  IntoFunction run_into;
+};
+
+/**
+ * @brief Add a backend to the process-wide registry.
+ *
+ * The registry initially holds the baseline, the optimized CPU implementation in several configurations, and the CUDA
+ * implementation if it was built. A runtime error is thrown if a backend with the same name already exists. Pointers to
+ * registered backends stay valid when more backends are registered.
+ */
+void registerBackend(const Backend &backend);
+
+/// @brief Return all registered backends, in order of registration.
+const std::deque<Backend> &getBackends();
+
+/// @brief Return the backend named \p name, or nullptr if there is no such backend.
+const Backend *findBackend(const std::string &name);
+
+/**
+ * @brief Run \p backend on \p src, with the result going into \p dest, which has the dimensions of \p src.
+ *
+ * Backends that implement run_into write into \p dest directly, without any copy. For other backends, the result is
+ * copied into \p dest.
+ *
+ * @return Whether any stage produced an image. If not, \p dest is left unchanged.
+ */
+bool runBackendInto(const Backend &backend, const Image *src, const WaterEffectOptions *options, Image *dest);
+
+/**
+ * @brief Return the backend best suited for images of \p width x \p height.
+ *
+ * The name "auto" selects this backend from the command line.
+ */
+const Backend *selectBackend(unsigned int width, unsigned int height);
@@ -12,13 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
 #include "imgproc.hpp"
 
 ///@brief Check if the dimensions of two images are equal, or throw a domain error.
-static inline void checkDimensionsEqualOrThrow(const Image *a, const Image *b) {
-  assert(a != nullptr);
-  assert(b != nullptr);
-  if ((a->width != b->width) || (a->height != b->height)) {
+static inline void checkDimensionsEqualOrThrow(ConstImageView a, ConstImageView b) {
+  if ((a.width != b.width) || (a.height != b.height)) {
     throw std::domain_error("Source and destination image are not of equal dimensions.");
   }
 }
@@ -30,28 +32,37 @@ static inline void checkValidColorChannelOrThrow(int channel) {
   }
 }
 
-void convolute(const Image *src, Image *dest, const Kernel *kernel, int channel) {
+void convolute(ConstImageView src, ImageView dest, const Kernel *kernel, int channel) {
   // Check arguments
-  assert((src != nullptr) && (dest != nullptr) && (kernel != nullptr));
   checkDimensionsEqualOrThrow(src, dest);
+
+  convolute(src, Region(0, 0, src.width, src.height), dest, kernel, channel);
+}
+
+void convolute(ConstImageView src, const Region &region, ImageView dest, const Kernel *kernel, int channel) {
+  // Check arguments
+  assert(kernel != nullptr);
+  if (!region.within(src.width, src.height) || (dest.width != region.width) || (dest.height != region.height)) {
+    throw std::domain_error("Region does not lie within the source image, or is not of the size of the destination.");
+  }
   checkValidColorChannelOrThrow(channel);
 
-  // Loop over every pixel
-  for (int y = 0; y < src->height; y++) {
-    for (int x = 0; x < src->width; x++) {
+  // Loop over every pixel of the region
+  for (int y = 0; y < dest.height; y++) {
+    for (int x = 0; x < dest.width; x++) {
       // Convolution result
       auto c = 0.0;
       // Loop over every kernel weight
       for (int ky = -kernel->height / 2; ky <= kernel->height / 2; ky++) {
         for (int kx = -kernel->width / 2; kx <= kernel->width / 2; kx++) {
           // Convolute pixel x
-          int cx = x + kx;
+          int cx = (int) region.x + x + kx;
           // Convolute pixel y
-          int cy = y + ky;
+          int cy = (int) region.y + y + ky;
           // Bounds checking
-          if ((cx >= 0) && (cy >= 0) && (cx < src->width) && (cy < src->height)) {
+          if ((cx >= 0) && (cy >= 0) && (cx < src.width) && (cy < src.height)) {
             // Pixel value
-            auto v = (float) src->pixel(cx, cy).colors[channel];
+            auto v = (float) src.pixel(cx, cy).colors[channel];
             // Kernel weight
             auto k = kernel->weight(kx, ky);
             // Multiply and accumulate
@@ -60,21 +71,18 @@ void convolute(const Image *src, Image *dest, const Kernel *kernel, int channel)
         }
       }
       // Set the channel to the new color
-      dest->pixel(x, y).colors[channel] = (unsigned char) (c * kernel->scale);
+      dest.pixel(x, y).colors[channel] = (unsigned char) (c * kernel->scale);
     }
   }
 }
 
-Histogram getHistogram(const Image *src) {
-  // Check arguments
-  assert((src != nullptr));
-
+Histogram getHistogram(ConstImageView src) {
   Histogram hist;
 
-  for (int y = 0; y < src->height; y++) {
-    for (int x = 0; x < src->width; x++) {
+  for (int y = 0; y < src.height; y++) {
+    for (int x = 0; x < src.width; x++) {
       for (int c = 0; c < 4; c++) {
-        auto intensity = src->pixel(x, y).colors[c];
+        auto intensity = src.pixel(x, y).colors[c];
         hist(intensity, c)++;
       }
     }
@@ -83,10 +91,9 @@ Histogram getHistogram(const Image *src) {
   return hist;
 }
 
-void enhanceContrastLinearly(const Image *src, const Histogram *src_hist, Image *dest, int low, int high, int channel) {
+Lut getContrastLut(const Histogram *src_hist, Histogram::Count low, Histogram::Count high, int channel) {
   // Check arguments
-  assert((src != nullptr) && (src_hist != nullptr) && (dest != nullptr));
-  checkDimensionsEqualOrThrow(src, dest);
+  assert(src_hist != nullptr);
   checkValidColorChannelOrThrow(channel);
 
   unsigned char first = 0;
@@ -110,83 +117,161 @@ void enhanceContrastLinearly(const Image *src, const Histogram *src_hist, Image
   float scale = 255.0f / (last - first);
   auto offset = first;
 
-  // For every pixel
-  for (int y = 0; y < src->height; y++) {
-    for (int x = 0; x < src->width; x++) {
-      // Clamp anything above and below the threshold to 0...255
-      if (src->pixel(x, y).colors[channel] < first) {
-        dest->pixel(x, y).colors[channel] = 0;
-      } else if (src->pixel(x, y).colors[channel] > last) {
-        dest->pixel(x, y).colors[channel] = 255;
-      } else {
-        // Anything else is scaled
-        dest->pixel(x, y).colors[channel] = (unsigned char) (scale * (src->pixel(x, y).colors[channel] - offset));
-      }
+  // For every intensity
+  Lut lut;
+  for (int v = 0; v < 256; v++) {
+    // Clamp anything above and below the threshold to 0...255
+    if (v < first) {
+      lut.table[v] = 0;
+    } else if (v > last) {
+      lut.table[v] = 255;
+    } else {
+      // Anything else is scaled
+      lut.table[v] = (unsigned char) (scale * (v - offset));
     }
   }
 
+  return lut;
 }
 
-void applyRipple(const Image *src, Image *dest, float frequency) {
+void enhanceContrastLinearly(ConstImageView src, const Histogram *src_hist, ImageView dest, Histogram::Count low,
+                             Histogram::Count high, int channel) {
   // Check arguments
-  assert((src != nullptr) && (dest != nullptr));
+  assert(src_hist != nullptr);
   checkDimensionsEqualOrThrow(src, dest);
+  checkValidColorChannelOrThrow(channel);
 
-  // For every pixel
-  for (int y = 0; y < src->height; y++) {
-    for (int x = 0; x < src->width; x++) {
+  // Map every pixel through the lookup table of the channel
+  applyPixelOp(src, dest, lut(channel, getContrastLut(src_hist, low, high, channel)));
+}
 
-      // Make this pixel black by default
-      (*dest)(x, y) = Pixel{0, 0, 0, 0};
+/**
+ * @brief Obtain the source pixel (\p sx, \p sy) that the ripple effect gathers for destination pixel (\p x, \p y) of an
+ * image of \p width x \p height. Return false if the destination pixel is transparent.
+ */
+static inline bool getRippleSource(int x, int y, unsigned int width, unsigned int height, float frequency, int *sx,
+                                   int *sy) {
+  // Normalize x and y to [-1,1]. The quotients are taken in double and then rounded to float, which gives exactly the
+  // float quotient, even where -Ofast replaces the division by a multiplication with the reciprocal.
+  float nx = -1.0f + (float) ((2.0 * x) / width);
+  float ny = -1.0f + (float) ((2.0 * y) / height);
 
-      // Normalize x and y to [-1,1]
-      float nx = -1.0f + (2.0f * x) / src->width;
-      float ny = -1.0f + (2.0f * y) / src->height;
+  // Calculate distance to center
+  auto dist = std::sqrt(std::pow(ny, 2) + std::pow(nx, 2));
 
-      // Calculate distance to center
-      auto dist = std::sqrt(std::pow(ny, 2) + std::pow(nx, 2));
+  // Calculate angle
+  float angle = std::atan2(ny, nx);
 
-      // Calculate angle
-      float angle = std::atan2(ny, nx);
+  // Use a funky formula to make a lensing effect.
+  auto src_dist = std::pow(std::sin(dist * M_PI / 2.0 * frequency), 2);
 
-      // Use a funky formula to make a lensing effect.
-      auto src_dist = std::pow(std::sin(dist * M_PI / 2.0 * frequency), 2);
+  // Check if this pixel lies within the source range, otherwise make this pixel transparent.
+  if ((src_dist > 1.0f)) {
+    return false;
+  }
 
-      // Check if this pixel lies within the source range, otherwise make this pixel transparent.
-      if ((src_dist > 1.0f)) {
-        continue;
-      }
+  // Calculate normalized lensed X and Y
+  auto nsx = src_dist * std::cos(angle);
+  auto nsy = src_dist * std::sin(angle);
+
+  // Rescale to image size
+  *sx = int((nsx + 1.0) / 2 * width);
+  *sy = int((nsy + 1.0) / 2 * height);
+
+  // Check bounds on source pixel
+  return (*sx < width) && (*sy < height);
+}
+
+void applyRipple(ConstImageView src, ImageView dest, float frequency) {
+  // Check arguments
+  checkDimensionsEqualOrThrow(src, dest);
 
-      // Calculate normalized lensed X and Y
-      auto nsx = src_dist * std::cos(angle);
-      auto nsy = src_dist * std::sin(angle);
+  // For every pixel
+  for (int y = 0; y < src.height; y++) {
+    for (int x = 0; x < src.width; x++) {
 
-      // Rescale to image size
-      auto sx = int((nsx + 1.0) / 2 * src->width);
-      auto sy = int((nsy + 1.0) / 2 * src->height);
+      // Make this pixel black by default
+      dest(x, y) = Pixel{0, 0, 0, 0};
 
-      // Check bounds on source pixel
-      if ((sx >= src->width) || (sy >= src->height)) {
+      int sx, sy;
+      if (!getRippleSource(x, y, src.width, src.height, frequency, &sx, &sy)) {
         continue;
       }
 
       // Set destination pixel from source
-      dest->pixel(x, y) = src->pixel(sx, sy);
+      dest.pixel(x, y) = src.pixel(sx, sy);
     }
   }
 }
 
-void copyChannel(const Image *src, Image *dest, int channel) {
+void applyRipple(ConstImageView src, const Region &src_region, ImageView dest, const RippleSources &sources) {
   // Check arguments
-  assert((src != nullptr) && (dest != nullptr));
-  checkDimensionsEqualOrThrow(src, dest);
-  checkValidColorChannelOrThrow(channel);
+  if ((src.width != src_region.width) || (src.height != src_region.height)
+      || (dest.width != sources.dest_region.width) || (dest.height != sources.dest_region.height)) {
+    throw std::domain_error("Image views and regions are not of equal dimensions.");
+  }
+  if (!sources.src_region.empty() && !src_region.contains(sources.src_region)) {
+    throw std::domain_error("Source region does not hold all pixels the ripple effect gathers.");
+  }
 
   // For every pixel
-  for (int y = 0; y < src->height; y++) {
-    for (int x = 0; x < src->width; x++) {
-      // Just copy the value.
-      dest->pixel(x, y).colors[channel] = src->pixel(x, y).colors[channel];
+  size_t i = 0;
+  for (int y = 0; y < dest.height; y++) {
+    for (int x = 0; x < dest.width; x++, i++) {
+      // Make transparent pixels black, and gather the others from their source
+      if (sources.x[i] < 0) {
+        dest(x, y) = Pixel{0, 0, 0, 0};
+      } else {
+        dest(x, y) = src.pixel(sources.x[i] - (int) src_region.x, sources.y[i] - (int) src_region.y);
+      }
     }
   }
 }
+
+RippleSources getRippleSources(const Region &dest_region, unsigned int width, unsigned int height, float frequency) {
+  if (!dest_region.within(width, height)) {
+    throw std::domain_error("Region does not lie within the image.");
+  }
+
+  RippleSources sources;
+  sources.dest_region = dest_region;
+  sources.x.resize((size_t) dest_region.width * dest_region.height);
+  sources.y.resize(sources.x.size());
+
+  // Obtain the source of every pixel, and grow the bounding box by it.
+  int x0 = INT_MAX;
+  int y0 = INT_MAX;
+  int x1 = INT_MIN;
+  int y1 = INT_MIN;
+  size_t i = 0;
+  for (unsigned int y = dest_region.y; y < dest_region.y + dest_region.height; y++) {
+    for (unsigned int x = dest_region.x; x < dest_region.x + dest_region.width; x++, i++) {
+      int sx, sy;
+      if (getRippleSource(x, y, width, height, frequency, &sx, &sy)) {
+        x0 = std::min(x0, sx);
+        y0 = std::min(y0, sy);
+        x1 = std::max(x1, sx);
+        y1 = std::max(y1, sy);
+      } else {
+        sx = -1;
+        sy = -1;
+      }
+      sources.x[i] = sx;
+      sources.y[i] = sy;
+    }
+  }
+
+  if (x0 <= x1) {
+    sources.src_region = Region(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+  }
+  return sources;
+}
+
+void copyChannel(ConstImageView src, ImageView dest, int channel) {
+  // Check arguments
+  checkDimensionsEqualOrThrow(src, dest);
+  checkValidColorChannelOrThrow(channel);
+
+  // Just copy the value of every pixel.
+  applyPixelOp(src, dest, passthrough(channel));
+}
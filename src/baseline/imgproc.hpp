@@ -14,9 +14,19 @@
 
 #pragma once
 
+#include <vector>
+
 #include "../utils/Image.hpp"
+#include "../utils/ImageView.hpp"
 #include "../utils/Kernel.hpp"
 #include "../utils/Histogram.hpp"
+#include "../utils/PixelOps.hpp"
+
+/*
+ * All functions take image views, so they process a whole image, or a sub-rectangle of an image in place. A pointer to
+ * an Image converts to a view of the whole image. The ripple effect and the borders of the convolution are relative to
+ * the view.
+ */
 
 /**
  * @brief Convolute the image \p img with the kernel \p kernel on channel \p channel.
@@ -28,7 +38,20 @@
  * @param kernel    The convolution kernel.
  * @param channel   The color channel.
  */
-void convolute(const Image *src, Image *dest, const Kernel *kernel, int channel);
+void convolute(ConstImageView src, ImageView dest, const Kernel *kernel, int channel);
+
+/**
+ * @brief Convolute only the region \p region of \p src with the kernel \p kernel on channel \p channel.
+ *
+ * The result is identical to that region of the result of convolute() on all of \p src, and is stored in \p dest.
+ *
+ * @param src       The source image to convolute the kernel with.
+ * @param region    The region of \p src to convolute. A domain error is thrown if it does not lie within \p src.
+ * @param dest      The destination image, of the size of \p region.
+ * @param kernel    The convolution kernel.
+ * @param channel   The color channel.
+ */
+void convolute(ConstImageView src, const Region &region, ImageView dest, const Kernel *kernel, int channel);
 
 /**
  * @brief Obtain a histogram from \p img of a specific color \p channel.
@@ -36,7 +59,7 @@ void convolute(const Image *src, Image *dest, const Kernel *kernel, int channel)
  * @param src       The source image to obtain the histogram from.
  * @return          The histogram
  */
-Histogram getHistogram(const Image *src);
+Histogram getHistogram(ConstImageView src);
 
 /**
  * @brief Enhance the contrast of an image.
@@ -52,7 +75,19 @@ Histogram getHistogram(const Image *src);
  * @param high      Threshold for higher intensities.
  * @param channel   Color channel
  */
-void enhanceContrastLinearly(const Image *src, const Histogram *src_hist, Image *dest, int low, int high, int channel);
+void enhanceContrastLinearly(ConstImageView src, const Histogram *src_hist, ImageView dest, Histogram::Count low,
+                             Histogram::Count high, int channel);
+
+/**
+ * @brief Return the lookup table through which enhanceContrastLinearly() maps channel \p channel.
+ *
+ * @param src_hist  The source image histogram.
+ * @param low       Threshold for lower intensities.
+ * @param high      Threshold for higher intensities.
+ * @param channel   Color channel
+ * @return          The lookup table.
+ */
+Lut getContrastLut(const Histogram *src_hist, Histogram::Count low, Histogram::Count high, int channel);
 
 /**
  * @brief Apply a ripple effect to \p img.
@@ -63,7 +98,47 @@ void enhanceContrastLinearly(const Image *src, const Histogram *src_hist, Image
  * @param dest      The destination image.
  * @param intensity The intensity of the lens effect.
  */
-void applyRipple(const Image *src, Image *dest, float intensity);
+void applyRipple(ConstImageView src, ImageView dest, float intensity);
+
+/// @brief The source pixels that the ripple effect gathers for a region of an image.
+struct RippleSources {
+  /// @brief The region of the destination image.
+  Region dest_region;
+
+  /// @brief The bounding box of all source pixels, which is empty if every destination pixel is transparent.
+  Region src_region;
+
+  /// @brief Source column of every destination pixel in row-major order, or -1 if the pixel is transparent.
+  std::vector<int> x;
+
+  /// @brief Source row of every destination pixel in row-major order, or -1 if the pixel is transparent.
+  std::vector<int> y;
+};
+
+/**
+ * @brief Return the source pixels the ripple effect gathers for the region \p dest_region of an image.
+ *
+ * @param dest_region The region of the destination image.
+ * @param width       The width of the whole image.
+ * @param height      The height of the whole image.
+ * @param intensity   The intensity of the lens effect.
+ * @return            The source coordinates of every pixel of \p dest_region, and their bounding box.
+ */
+RippleSources getRippleSources(const Region &dest_region, unsigned int width, unsigned int height, float intensity);
+
+/**
+ * @brief Apply the ripple effect to a region of an image only, gathering through precomputed source pixels.
+ *
+ * The source pixels only depend on the geometry, so the bounding box that a region reads is known before any pixel is
+ * gathered, and no coordinate is evaluated twice. The result is identical to the region of the result of applyRipple()
+ * on the whole image.
+ *
+ * @param src         A view of the region \p src_region of the source image, which must hold sources.src_region.
+ * @param src_region  The region of the source image that \p src views.
+ * @param dest        A view of the region sources.dest_region of the destination image.
+ * @param sources     The source pixels of the destination region.
+ */
+void applyRipple(ConstImageView src, const Region &src_region, ImageView dest, const RippleSources &sources);
 
 /**
  * Copy a color channel from one image to the other.
@@ -71,4 +146,4 @@ void applyRipple(const Image *src, Image *dest, float intensity);
  * @param dest      The destination image.
  * @param channel   The color channel.
  */
-void copyChannel(const Image *src, Image *dest, int channel);
\ No newline at end of file
+void copyChannel(ConstImageView src, ImageView dest, int channel);
\ No newline at end of file
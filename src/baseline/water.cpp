@@ -12,8 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <utility>
+
 #include "../utils/Timer.hpp"
 #include "../utils/Histogram.hpp"
+#include "../utils/ImageWriter.hpp"
 
 #include "imgproc.hpp"
 
@@ -24,10 +27,10 @@ std::shared_ptr<Histogram> runHistogramStage(const Image *previous, const WaterE
   // Obtain the histogram
   auto hist = std::make_shared<Histogram>(getHistogram(previous));
 
-  // Optionally save the intermediate histogram as an image
+  // Optionally save the intermediate histogram as an image, in the background
   if (options->save_intermediate) {
     auto hist_img = hist->toImage();
-    hist_img->toPNG("output/" + options->img_name + "_histogram.png");
+    ImageWriter::instance().write(hist_img, options->outputFile("_histogram"));
   }
   return hist;
 }
@@ -42,7 +45,7 @@ std::shared_ptr<Image> runEnhanceStage(const Image *previous,
   }
 
   // Determine the threshold from the histogram, by taking 10% of the maximum value in the histogram.
-  auto threshold = (int) (hist->max(0) * 0.1);
+  auto threshold = (Histogram::Count) (hist->max(0) * 0.1);
 
   // Create a new image to store the result
   auto img_enhanced = std::make_shared<Image>(previous->width, previous->height);
@@ -55,9 +58,9 @@ std::shared_ptr<Image> runEnhanceStage(const Image *previous,
   // Copy over the alpha channel
   copyChannel(previous, img_enhanced.get(), 3);
 
-  // Save the resulting image
+  // Save the resulting image in the background
   if (options->save_intermediate)
-    img_enhanced->toPNG("output/" + options->img_name + "_enhanced.png");
+    ImageWriter::instance().write(img_enhanced, options->outputFile("_enhanced"));
 
   // Set the previous image to point to the enhanced image for next stages.
   previous = img_enhanced.get();
@@ -66,7 +69,8 @@ std::shared_ptr<Image> runEnhanceStage(const Image *previous,
   if (options->enhance_hist) {
     auto enhanced_hist = getHistogram(img_enhanced.get());
     auto enhanced_hist_img = enhanced_hist.toImage();
-    enhanced_hist_img->toPNG("output/" + options->img_name + "_enhanced_histogram.png");
+    ImageWriter::instance().write(enhanced_hist_img,
+                                options->outputFile("_enhanced_histogram"));
   }
 
   return img_enhanced;
@@ -80,9 +84,9 @@ std::shared_ptr<Image> runRippleStage(const Image *previous, const WaterEffectOp
   // Apply the ripple effect
   applyRipple(previous, img_rippled.get(), options->ripple_frequency);
 
-  // Save the resulting image
+  // Save the resulting image in the background
   if (options->save_intermediate)
-    img_rippled->toPNG("output/" + options->img_name + "_rippled.png");
+    ImageWriter::instance().write(img_rippled, options->outputFile("_rippled"));
 
   return img_rippled;
 }
@@ -101,9 +105,9 @@ std::shared_ptr<Image> runBlurStage(const Image *previous, const WaterEffectOpti
   convolute(previous, img_blurred.get(), &gaussian, 2);
   convolute(previous, img_blurred.get(), &gaussian, 3);
 
-  // Save the resulting image
+  // Save the resulting image in the background
   if (options->save_intermediate)
-    img_blurred->toPNG("output/" + options->img_name + "_blurred.png");
+    ImageWriter::instance().write(img_blurred, options->outputFile("_blurred"));
 
   return img_blurred;
 }
@@ -121,7 +125,8 @@ std::shared_ptr<Image> runWaterEffect(const Image *src, const WaterEffectOptions
     ts.start();
     hist = runHistogramStage(src, options);
     ts.stop();
-    std::cout << "Stage: Histogram:        " << ts.seconds() << " s." << std::endl;
+    if (options->report_stages)
+      std::cout << "Stage: Histogram:        " << ts.seconds() << " s." << std::endl;
   }
 
   // Contrast enhancement stage
@@ -132,7 +137,8 @@ std::shared_ptr<Image> runWaterEffect(const Image *src, const WaterEffectOptions
     }
     img_result = runEnhanceStage(src, hist.get(), options);
     ts.stop();
-    std::cout << "Stage: Contrast enhance: " << ts.seconds() << " s." << std::endl;
+    if (options->report_stages)
+      std::cout << "Stage: Contrast enhance: " << ts.seconds() << " s." << std::endl;
   }
 
   // Ripple effect stage
@@ -144,7 +150,8 @@ std::shared_ptr<Image> runWaterEffect(const Image *src, const WaterEffectOptions
       img_result = runRippleStage(img_result.get(), options);
     }
     ts.stop();
-    std::cout << "Stage: Ripple effect:    " << ts.seconds() << " s." << std::endl;
+    if (options->report_stages)
+      std::cout << "Stage: Ripple effect:    " << ts.seconds() << " s." << std::endl;
   }
 
   // Gaussian blur stage
@@ -156,7 +163,142 @@ std::shared_ptr<Image> runWaterEffect(const Image *src, const WaterEffectOptions
       img_result = runBlurStage(img_result.get(), options);
     }
     ts.stop();
-    std::cout << "Stage: Blur:             " << ts.seconds() << " s." << std::endl;
+    if (options->report_stages)
+      std::cout << "Stage: Blur:             " << ts.seconds() << " s." << std::endl;
+  }
+
+  return img_result;
+}
+
+Region getWaterEffectInputRegion(const Region &roi, unsigned int width, unsigned int height,
+                                 const WaterEffectOptions *options, RippleSources *sources) {
+  Region blur_in = options->blur ? roi.grow(options->blur_size / 2, width, height) : roi;
+  if (!options->ripple) {
+    return blur_in;
+  }
+  RippleSources ripple_sources = getRippleSources(blur_in, width, height, options->ripple_frequency);
+  Region ripple_in = ripple_sources.src_region;
+  if (sources != nullptr) {
+    *sources = std::move(ripple_sources);
+  }
+  return ripple_in;
+}
+
+std::shared_ptr<Image> runWaterEffect(const Image *src, const WaterEffectOptions *options, const Region &roi,
+                                      const Histogram *hist) {
+  if (roi.empty() || !roi.within(src->width, src->height)) {
+    throw std::domain_error("Region of interest must be a non-empty region of the source image.");
+  }
+
+  // Histogram stage, which is global.
+  std::shared_ptr<Histogram> src_hist;
+  if (options->histogram && (hist == nullptr)) {
+    Timer ts;
+    ts.start();
+    src_hist = std::make_shared<Histogram>(getHistogram(src));
+    hist = src_hist.get();
+    ts.stop();
+    if (options->report_stages)
+      std::cout << "Stage: Histogram:        " << ts.seconds() << " s." << std::endl;
+  }
+
+  return runWaterEffect(src, Region(0, 0, src->width, src->height), src->width, src->height, options, roi, hist);
+}
+
+std::shared_ptr<Image> runWaterEffect(ConstImageView window, const Region &window_region, unsigned int width,
+                                      unsigned int height, const WaterEffectOptions *options, const Region &roi,
+                                      const Histogram *hist, const RippleSources *sources) {
+  if (roi.empty() || !roi.within(width, height)) {
+    throw std::domain_error("Region of interest must be a non-empty region of the source image.");
+  }
+  if ((window.width != window_region.width) || (window.height != window_region.height)) {
+    throw std::domain_error("Window is not of the size of its region.");
+  }
+  if (options->enhance && (hist == nullptr)) {
+    throw std::runtime_error("Cannot run enhance stage without histogram.");
+  }
+
+  // Infer the region every stage has to produce, from the last stage back to the first.
+  const int halo = options->blur_size / 2;
+  Region blur_in = options->blur ? roi.grow(halo, width, height) : roi;
+  Region ripple_out = blur_in;
+  RippleSources own_sources;
+  if (options->ripple && (sources == nullptr)) {
+    own_sources = getRippleSources(ripple_out, width, height, options->ripple_frequency);
+    sources = &own_sources;
+  } else if (options->ripple && !(sources->dest_region == ripple_out)) {
+    throw std::domain_error("Ripple sources are not those of the region of interest.");
+  }
+  Region ripple_in = options->ripple ? sources->src_region : ripple_out;
+  Region enhance_out = ripple_in;
+  if (!enhance_out.empty() && !window_region.contains(enhance_out)) {
+    throw std::domain_error("Window does not hold the input region of the region of interest.");
+  }
+
+  // Stage timer
+  Timer ts;
+
+  // The latest image of the pipeline, which holds the region `region` of the whole image.
+  ConstImageView current = window;
+  Region region = window_region;
+  std::shared_ptr<Image> img_result;
+
+  // Contrast enhancement stage
+  if (options->enhance) {
+    ts.start();
+    auto threshold = (Histogram::Count) (hist->max(0) * 0.1);
+    auto in = current.sub(enhance_out.x - region.x, enhance_out.y - region.y, enhance_out.width, enhance_out.height);
+    img_result = std::make_shared<Image>(enhance_out.width, enhance_out.height);
+    enhanceContrastLinearly(in, hist, img_result.get(), threshold, threshold, 0);
+    enhanceContrastLinearly(in, hist, img_result.get(), threshold, threshold, 1);
+    enhanceContrastLinearly(in, hist, img_result.get(), threshold, threshold, 2);
+    copyChannel(in, img_result.get(), 3);
+    current = img_result.get();
+    region = enhance_out;
+    ts.stop();
+    if (options->report_stages)
+      std::cout << "Stage: Contrast enhance: " << ts.seconds() << " s." << std::endl;
+  }
+
+  // Ripple effect stage
+  if (options->ripple) {
+    ts.start();
+    auto img_rippled = std::make_shared<Image>(ripple_out.width, ripple_out.height);
+    if (ripple_in.empty()) {
+      std::fill(img_rippled->pixels, img_rippled->pixels + (size_t) ripple_out.width * ripple_out.height,
+                Pixel{0, 0, 0, 0});
+    } else {
+      auto in = current.sub(ripple_in.x - region.x, ripple_in.y - region.y, ripple_in.width, ripple_in.height);
+      applyRipple(in, ripple_in, img_rippled.get(), *sources);
+    }
+    img_result = img_rippled;
+    current = img_result.get();
+    region = ripple_out;
+    ts.stop();
+    if (options->report_stages)
+      std::cout << "Stage: Ripple effect:    " << ts.seconds() << " s." << std::endl;
+  }
+
+  // Gaussian blur stage
+  if (options->blur) {
+    ts.start();
+    Kernel gaussian = Kernel::gaussian(options->blur_size, options->blur_size, 1.0);
+
+    // Convolute only the ROI of the input region. The input region holds the ROI and its halo, clipped where the whole
+    // image ends, so the convolution sees the same pixels and the same zero border as on the whole image.
+    auto in = current.sub(blur_in.x - region.x, blur_in.y - region.y, blur_in.width, blur_in.height);
+    const Region blur_roi(roi.x - blur_in.x, roi.y - blur_in.y, roi.width, roi.height);
+    auto img_blurred = std::make_shared<Image>(roi.width, roi.height);
+    convolute(in, blur_roi, img_blurred.get(), &gaussian, 0);
+    convolute(in, blur_roi, img_blurred.get(), &gaussian, 1);
+    convolute(in, blur_roi, img_blurred.get(), &gaussian, 2);
+    convolute(in, blur_roi, img_blurred.get(), &gaussian, 3);
+    img_result = img_blurred;
+    current = img_result.get();
+    region = roi;
+    ts.stop();
+    if (options->report_stages)
+      std::cout << "Stage: Blur:             " << ts.seconds() << " s." << std::endl;
   }
 
   return img_result;
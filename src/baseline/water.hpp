@@ -18,6 +18,10 @@
 #include <memory>
 
 #include "../utils/Image.hpp"
+#include "../utils/Histogram.hpp"
+#include "../utils/ImageView.hpp"
+
+struct RippleSources;
 
 /// @brief structure to pass pipeline options
 struct WaterEffectOptions {
@@ -29,7 +33,17 @@ struct WaterEffectOptions {
   bool enhance_hist = false;
   bool ripple = false;
   float ripple_frequency = 2 * 1.337f;
+  unsigned int ripple_map_step = 1;
+  bool ripple_map_compact = false;
   bool save_intermediate = false;
+  bool report_stages = true;
+  std::string image_extension = ".png";
+  std::string output_dir = "output";
+
+  /// @brief Return the file name of the output image of this image with the suffix \p suffix, such as "_result".
+  std::string outputFile(const std::string &suffix) const {
+    return output_dir + "/" + img_name + suffix + image_extension;
+  }
 };
 
 /**
@@ -40,3 +54,69 @@ struct WaterEffectOptions {
  * @return          A smart pointer to a new image.
  */
 std::shared_ptr<Image> runWaterEffect(const Image *src, const WaterEffectOptions *options);
+
+/**
+ * @brief Return the region \p roi of the image on which a water effect was applied, computing only that region.
+ *
+ * The input region of every stage is inferred from the output region of the next stage: the blur stage grows it by
+ * half the kernel size, and the ripple stage maps it back to the bounding box of the pixels it gathers from. Only those
+ * regions are processed, so the work scales with the size of the ROI rather than of the image. The histogram is
+ * always obtained from the whole image, so it can be passed in to reuse it for other regions of the same image.
+ * Intermediate images are not saved. The result is identical to region \p roi of the result of runWaterEffect().
+ *
+ * @param src       The source image.
+ * @param options   The options for the water effect.
+ * @param roi       The region of the result to compute. A domain error is thrown if it does not lie within \p src.
+ * @param hist      The histogram of \p src, or nullptr to obtain it if the histogram stage is enabled.
+ * @return          A smart pointer to a new image of the size of \p roi, or nullptr if no stage produces an image.
+ */
+std::shared_ptr<Image> runWaterEffect(const Image *src, const WaterEffectOptions *options, const Region &roi,
+                                      const Histogram *hist = nullptr);
+
+/**
+ * @brief Return the region \p roi of the image on which a water effect was applied, from a window of the source image.
+ *
+ * This is the same as the overload taking the whole source image, except that only a window of the source image has
+ * to be in memory, such as a region read from a TiledImage. The window must hold the region returned by
+ * getWaterEffectInputRegion() for \p roi. Intermediate images are not saved.
+ *
+ * @param window        The window of the source image.
+ * @param window_region The region of the source image that the window holds.
+ * @param width         The width of the whole source image.
+ * @param height        The height of the whole source image.
+ * @param options       The options for the water effect.
+ * @param roi           The region of the result to compute. It must lie within the whole source image.
+ * @param hist          The histogram of the whole source image. It is required if the enhance stage is enabled.
+ * @param sources       The ripple sources returned by getWaterEffectInputRegion() for \p roi, or nullptr to obtain
+ *                      them again.
+ * @return              A smart pointer to a new image of the size of \p roi, or nullptr if no stage produces an image.
+ */
+std::shared_ptr<Image> runWaterEffect(ConstImageView window, const Region &window_region, unsigned int width,
+                                      unsigned int height, const WaterEffectOptions *options, const Region &roi,
+                                      const Histogram *hist, const RippleSources *sources = nullptr);
+
+/**
+ * @brief Return the region of the source image that the water effect reads to produce the region \p roi of the result.
+ *
+ * @param roi     The region of the result.
+ * @param width   The width of the whole source image.
+ * @param height  The height of the whole source image.
+ * @param options The options for the water effect.
+ * @param sources If not nullptr and the ripple stage is enabled, receives the ripple sources that the region pipeline
+ *                of runWaterEffect() can reuse, so they are not evaluated twice.
+ * @return        The input region, which is empty if every pixel of \p roi is transparent.
+ */
+Region getWaterEffectInputRegion(const Region &roi, unsigned int width, unsigned int height,
+                                 const WaterEffectOptions *options, RippleSources *sources = nullptr);
+
+/// @brief Run the histogram stage.
+std::shared_ptr<Histogram> runHistogramStage(const Image *previous, const WaterEffectOptions *options);
+
+/// @brief Run the contrast enhancement stage.
+std::shared_ptr<Image> runEnhanceStage(const Image *previous, const Histogram *hist, const WaterEffectOptions *options);
+
+/// @brief Run the ripple effect stage.
+std::shared_ptr<Image> runRippleStage(const Image *previous, const WaterEffectOptions *options);
+
+/// @brief Run the blur stage.
+std::shared_ptr<Image> runBlurStage(const Image *previous, const WaterEffectOptions *options);
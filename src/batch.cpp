@@ -0,0 +1,211 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "utils/BoundedQueue.hpp"
+#include "utils/Image.hpp"
+#include "utils/Timer.hpp"
+
+#include "batch.hpp"
+
+/// @brief An image on its way through the batch pipeline.
+struct BatchItem {
+  /// @brief Name of the image, without directory and extension.
+  std::string name;
+  /// @brief The decoded input image, or the processed result.
+  std::shared_ptr<Image> image;
+};
+
+/// @brief Return the file name of \p path without its directory and extension.
+static std::string getImageName(const std::string &path) {
+  auto name = path.substr(path.find_last_of("\\/") + 1);
+  return name.substr(0, name.find_last_of('.'));
+}
+
+void BatchStats::report(std::ostream &os) const {
+  os << "Batch: " << images << " images, " << pixels * 1e-6 << " MP in " << seconds << " s: "
+     << images / seconds << " images/s, " << pixels * 1e-6 / seconds << " MP/s." << std::endl;
+  os << "Batch stages: decode " << decode_seconds << " s, process " << process_seconds << " s, encode "
+     << encode_seconds << " s." << std::endl;
+  if (failures > 0) {
+    os << "Batch: " << failures << " images failed." << std::endl;
+  }
+}
+
+std::vector<std::string> getBatchInputs(const std::string &path) {
+  std::vector<std::string> files;
+
+  struct stat info;
+  if ((stat(path.c_str(), &info) == 0) && S_ISDIR(info.st_mode)) {
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+      throw std::runtime_error("Could not open directory " + path + ".");
+    }
+    while (struct dirent *entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      auto dot = name.find_last_of('.');
+      auto ext = (dot == std::string::npos) ? std::string() : name.substr(dot);
+      if ((ext == ".png") || Image::isPAM(name) || Image::isQOI(name)) {
+        files.push_back(path + "/" + name);
+      }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+  }
+
+  std::ifstream list(path);
+  if (!list) {
+    throw std::runtime_error("Could not open image list " + path + ".");
+  }
+  std::string line;
+  while (std::getline(list, line)) {
+    if (!line.empty()) {
+      files.push_back(line);
+    }
+  }
+  return files;
+}
+
+BatchStats runBatch(const std::vector<std::string> &files, const Backend *backend, const WaterEffectOptions *options,
+                    const BatchOptions &batch) {
+  BatchStats stats;
+  std::mutex stats_mutex;
+
+  BoundedQueue<BatchItem> decoded(batch.queue_capacity);
+  BoundedQueue<BatchItem> processed(batch.queue_capacity);
+  std::atomic<size_t> next_file{0};
+
+  // Report a failed image.
+  auto fail = [&](const std::string &name, const std::string &what) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    std::cerr << "Batch: " << name << ": " << what << std::endl;
+    stats.failures++;
+  };
+
+  auto decode = [&]() {
+    Timer t;
+    double busy = 0.0;
+    for (size_t i = next_file++; i < files.size(); i = next_file++) {
+      BatchItem item;
+      item.name = getImageName(files[i]);
+      t.start();
+      try {
+        item.image = Image::fromFile(files[i]);
+      } catch (const std::exception &e) {
+        fail(files[i], e.what());
+        continue;
+      }
+      t.stop();
+      busy += t.seconds();
+      decoded.push(std::move(item));
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.decode_seconds += busy;
+  };
+
+  auto process = [&]() {
+    Timer t;
+    double busy = 0.0;
+    BatchItem item;
+    while (decoded.pop(&item)) {
+      WaterEffectOptions image_options = *options;
+      image_options.img_name = item.name;
+      image_options.report_stages = false;
+      const Backend *b = (backend != nullptr) ? backend : selectBackend(item.image->width, item.image->height);
+      t.start();
+      try {
+        item.image = b->run(item.image.get(), &image_options);
+      } catch (const std::exception &e) {
+        fail(item.name, e.what());
+        continue;
+      }
+      t.stop();
+      busy += t.seconds();
+      if (item.image == nullptr) {
+        fail(item.name, "no stage produced an image.");
+        continue;
+      }
+      processed.push(std::move(item));
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.process_seconds += busy;
+  };
+
+  auto encode = [&]() {
+    Timer t;
+    double busy = 0.0;
+    size_t images = 0;
+    std::uint64_t pixels = 0;
+    BatchItem item;
+    while (processed.pop(&item)) {
+      t.start();
+      auto file_name = options->output_dir + "/" + item.name + "_result" + options->image_extension;
+      unsigned int error = item.image->toFile(file_name);
+      t.stop();
+      busy += t.seconds();
+      if (error != 0) {
+        fail(item.name, "could not write result (error " + std::to_string(error) + ").");
+        continue;
+      }
+      images++;
+      pixels += (std::uint64_t) item.image->width * item.image->height;
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.encode_seconds += busy;
+    stats.images += images;
+    stats.pixels += pixels;
+  };
+
+  // Start every group, and close the queue behind a group once all of its threads are done.
+  auto start = [](unsigned int threads, const std::function<void()> &fn) {
+    std::vector<std::thread> group;
+    for (unsigned int i = 0; i < std::max(1u, threads); i++) {
+      group.emplace_back(fn);
+    }
+    return group;
+  };
+  auto join = [](std::vector<std::thread> &group) {
+    for (auto &thread : group) {
+      thread.join();
+    }
+  };
+
+  Timer tt;
+  tt.start();
+  auto decoders = start(batch.decoders, decode);
+  auto workers = start(batch.workers, process);
+  auto encoders = start(batch.encoders, encode);
+  join(decoders);
+  decoded.close();
+  join(workers);
+  processed.close();
+  join(encoders);
+  tt.stop();
+  stats.seconds = tt.seconds();
+
+  return stats;
+}
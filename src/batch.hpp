@@ -0,0 +1,84 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "baseline/water.hpp"
+#include "backends.hpp"
+
+/// @brief Options of batch processing.
+struct BatchOptions {
+  /// @brief Number of threads decoding images.
+  unsigned int decoders = 1;
+  /// @brief Number of threads running the water effect. Every one of them may use the thread pool, if the backend does.
+  unsigned int workers = 1;
+  /// @brief Number of threads encoding images.
+  unsigned int encoders = 1;
+  /// @brief Maximum number of images waiting between two stages.
+  size_t queue_capacity = 4;
+};
+
+/// @brief Statistics of a batch run.
+struct BatchStats {
+  /// @brief Number of images processed successfully.
+  size_t images = 0;
+  /// @brief Number of images that could not be decoded, processed or encoded.
+  size_t failures = 0;
+  /// @brief Total number of pixels of the processed images.
+  std::uint64_t pixels = 0;
+  /// @brief Wall time of the whole batch, in seconds.
+  double seconds = 0.0;
+  /// @brief Time spent decoding, summed over all decoder threads, in seconds.
+  double decode_seconds = 0.0;
+  /// @brief Time spent processing, summed over all worker threads, in seconds.
+  double process_seconds = 0.0;
+  /// @brief Time spent encoding, summed over all encoder threads, in seconds.
+  double encode_seconds = 0.0;
+
+  /// @brief Print the throughput and the time spent per stage on some output stream.
+  void report(std::ostream &os = std::cout) const;
+};
+
+/**
+ * @brief Return the input images of a batch.
+ *
+ * If \p path is a directory, all PNG, PAM and QOI files in it are returned, sorted by name. Otherwise, \p path is read as a
+ * text file that lists one image per line. Empty lines are skipped. A runtime error is thrown if \p path cannot be
+ * read.
+ */
+std::vector<std::string> getBatchInputs(const std::string &path);
+
+/**
+ * @brief Apply the water effect to every image in \p files.
+ *
+ * Decoding, processing and encoding run on separate groups of threads, connected by bounded queues, so the three
+ * stages of different images overlap while the number of images in memory stays bounded. The result of an image
+ * named name.png is written to name_result in the output directory, with the image extension of the options. Images
+ * that fail are reported and skipped.
+ *
+ * @param files   The input images.
+ * @param backend The backend to process the images with, or nullptr to select it per image from its size.
+ * @param options The water effect options. The image name is set per image.
+ * @param batch   The batch options.
+ * @return        The batch statistics.
+ */
+BatchStats runBatch(const std::vector<std::string> &files, const Backend *backend, const WaterEffectOptions *options,
+                    const BatchOptions &batch);
@@ -0,0 +1,220 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../utils/PixelOps.hpp"
+#include "../baseline/imgproc.hpp"
+
+#include "imgproc_cpu.hpp"
+
+/// @brief Number of rows per task of the per-pixel stages.
+static const size_t band_rows = 64;
+
+std::shared_ptr<const Kernel> getGaussianKernel(int size, float sigma) {
+  static std::mutex mutex;
+  static std::map<std::pair<int, float>, std::shared_ptr<const Kernel>> kernels;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &kernel = kernels[std::make_pair(size, sigma)];
+  if (kernel == nullptr) {
+    kernel = std::make_shared<const Kernel>(Kernel::gaussian(size, size, sigma));
+  }
+  return kernel;
+}
+
+///@brief Check if the dimensions of two images are equal, or throw a domain error.
+static inline void checkDimensionsEqualOrThrow(const Image *a, const Image *b) {
+  assert(a != nullptr);
+  assert(b != nullptr);
+  if ((a->width != b->width) || (a->height != b->height)) {
+    throw std::domain_error("Source and destination image are not of equal dimensions.");
+  }
+}
+
+/**
+ * @brief Fill \p scratch with the source pixels of the rectangle [x0, x0 + sw) x [y0, y0 + sh).
+ *
+ * Pixels outside of the image are zero, such that they do not contribute to a convolution. If \p index is not null,
+ * the pixels are gathered through the ripple map index.
+ */
+static void fillScratch(const Image *src, const std::uint32_t *index, Pixel *scratch, int x0, int y0, int sw, int sh) {
+  const int width = src->width;
+  const int height = src->height;
+
+  for (int sy = 0; sy < sh; sy++) {
+    const int y = y0 + sy;
+    Pixel *row = scratch + (size_t) sy * sw;
+
+    if ((y < 0) || (y >= height)) {
+      std::fill(row, row + sw, Pixel{0, 0, 0, 0});
+      continue;
+    }
+
+    for (int sx = 0; sx < sw; sx++) {
+      const int x = x0 + sx;
+      if ((x < 0) || (x >= width)) {
+        row[sx] = Pixel{0, 0, 0, 0};
+      } else if (index == nullptr) {
+        row[sx] = src->pixels[(size_t) y * width + x];
+      } else {
+        const std::uint32_t i = index[(size_t) y * width + x];
+        row[sx] = (i == RippleMap::transparent) ? Pixel{0, 0, 0, 0} : src->pixels[i];
+      }
+    }
+  }
+}
+
+void convoluteTiled(const Image *src, Image *dest, const Kernel *kernel, const RippleMap *map,
+                    unsigned int tile_size, ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr) && (kernel != nullptr) && (pool != nullptr));
+  checkDimensionsEqualOrThrow(src, dest);
+  if ((map != nullptr) && ((map->width != src->width) || (map->height != src->height))) {
+    throw std::domain_error("Source image and ripple map are not of equal dimensions.");
+  }
+  if (tile_size == 0) {
+    throw std::domain_error("Tile size must be positive.");
+  }
+
+  const int hx = kernel->width / 2;
+  const int hy = kernel->height / 2;
+  const std::uint32_t *index = (map == nullptr) ? nullptr : map->index.data();
+
+  // For every destination tile
+  pool->parallelFor2D(src->width, src->height, tile_size, tile_size, [&](int tx, int x1, int ty, int y1) {
+    const int tw = x1 - tx;
+    const int th = y1 - ty;
+    const int sw = tw + 2 * hx;
+    const int sh = th + 2 * hy;
+
+    // Scratch buffer holding a tile plus its halo, reused for all tiles processed by this thread.
+    thread_local std::vector<Pixel> scratch;
+    scratch.resize((size_t) sw * sh);
+    fillScratch(src, index, scratch.data(), tx - hx, ty - hy, sw, sh);
+
+    // Convolute the tile, accumulating all channels in the same order as convolute() does.
+    for (int y = 0; y < th; y++) {
+      for (int x = 0; x < tw; x++) {
+        double c[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int ky = -hy; ky <= hy; ky++) {
+          const Pixel *row = scratch.data() + (size_t) (y + hy + ky) * sw + (x + hx);
+          for (int kx = -hx; kx <= hx; kx++) {
+            auto k = kernel->weight(kx, ky);
+            for (int ch = 0; ch < 4; ch++) {
+              c[ch] += (float) row[kx].colors[ch] * k;
+            }
+          }
+        }
+        Pixel &p = dest->pixel(tx + x, ty + y);
+        for (int ch = 0; ch < 4; ch++) {
+          p.colors[ch] = (unsigned char) (c[ch] * kernel->scale);
+        }
+      }
+    }
+  });
+}
+
+void convolutePadded(const PaddedImage *src, Image *dest, const Kernel *kernel, unsigned int tile_size,
+                     ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr) && (kernel != nullptr) && (pool != nullptr));
+  if ((src->width != dest->width) || (src->height != dest->height)) {
+    throw std::domain_error("Source and destination image are not of equal dimensions.");
+  }
+  const int hx = kernel->width / 2;
+  const int hy = kernel->height / 2;
+  if ((int) src->halo < std::max(hx, hy)) {
+    throw std::domain_error("Halo of the padded image is smaller than half the kernel size.");
+  }
+  if (tile_size == 0) {
+    throw std::domain_error("Tile size must be positive.");
+  }
+
+  // For every destination tile
+  pool->parallelFor2D(src->width, src->height, tile_size, tile_size, [&](int tx, int x1, int ty, int y1) {
+    // Convolute the tile, accumulating all channels in the same order as convolute() does.
+    for (int y = ty; y < y1; y++) {
+      Pixel *out = dest->pixels + (size_t) y * dest->width;
+      for (int x = tx; x < x1; x++) {
+        double c[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int ky = -hy; ky <= hy; ky++) {
+          const Pixel *row = src->row(y + ky) + x;
+          for (int kx = -hx; kx <= hx; kx++) {
+            auto k = kernel->weight(kx, ky);
+            for (int ch = 0; ch < 4; ch++) {
+              c[ch] += (float) row[kx].colors[ch] * k;
+            }
+          }
+        }
+        for (int ch = 0; ch < 4; ch++) {
+          out[x].colors[ch] = (unsigned char) (c[ch] * kernel->scale);
+        }
+      }
+    }
+  });
+}
+
+Histogram getHistogramCPU(const Image *src, ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (pool != nullptr));
+
+  const size_t width = src->width;
+
+  // Count every band of rows into its own histogram, and sum them up.
+  Histogram hist;
+  const size_t size = hist.values.size();
+  hist.values = pool->parallelReduce(
+      0, src->height, band_rows, std::vector<Histogram::Count>(size, 0),
+      [&](size_t y0, size_t y1) {
+        Histogram band;
+        const Pixel *p = src->pixels + y0 * width;
+        const Pixel *end = src->pixels + y1 * width;
+        for (; p < end; p++) {
+          for (int c = 0; c < 4; c++) {
+            band(p->colors[c], c)++;
+          }
+        }
+        return band.values;
+      },
+      [&](std::vector<Histogram::Count> a, const std::vector<Histogram::Count> &b) {
+        for (size_t i = 0; i < size; i++) {
+          a[i] += b[i];
+        }
+        return a;
+      });
+
+  return hist;
+}
+
+void enhanceContrastLinearlyCPU(const Image *src, const Histogram *src_hist, Image *dest, Histogram::Count low,
+                                Histogram::Count high, ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (src_hist != nullptr) && (dest != nullptr) && (pool != nullptr));
+  checkDimensionsEqualOrThrow(src, dest);
+
+  // Map the color channels through their lookup tables and copy the alpha channel, in a single pass.
+  const auto op = lut(getContrastLut(src_hist, low, high, 0), getContrastLut(src_hist, low, high, 1),
+                      getContrastLut(src_hist, low, high, 2)) | passthrough(3);
+
+  const size_t width = src->width;
+  pool->parallelFor(0, src->height, band_rows, [&](size_t y0, size_t y1) {
+    applyPixelOp(src->pixels + y0 * width, dest->pixels + y0 * width, (y1 - y0) * width, op);
+  });
+}
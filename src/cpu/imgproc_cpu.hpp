@@ -0,0 +1,95 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+
+#include "../utils/Image.hpp"
+#include "../utils/Kernel.hpp"
+#include "../utils/Histogram.hpp"
+#include "../utils/PaddedImage.hpp"
+#include "../utils/ThreadPool.hpp"
+
+#include "ripple_cpu.hpp"
+
+/**
+ * @brief Return a normalized Gaussian kernel of \p size x \p size with standard deviation \p sigma.
+ *
+ * Kernels are cached for the lifetime of the process, so repeated runs of the pipeline do not rebuild them. This
+ * function is thread-safe.
+ */
+std::shared_ptr<const Kernel> getGaussianKernel(int size, float sigma = 1.0f);
+
+/**
+ * @brief Convolute all color channels of \p src with the kernel \p kernel, one destination tile at a time.
+ *
+ * For every destination tile, the tile and a halo of half the kernel size are first copied into a thread-local
+ * scratch buffer, and then convoluted into \p dest. If a ripple map is supplied, the scratch buffer is filled by
+ * gathering through the map instead. This fuses the ripple and blur stages without ever materializing the full
+ * rippled image. Borders are handled like convolute() does.
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param kernel    The convolution kernel.
+ * @param map       An optional ripple map to apply to \p src before convoluting.
+ * @param tile_size The width and height of the destination tiles.
+ * @param pool      The thread pool that processes the tiles.
+ */
+void convoluteTiled(const Image *src, Image *dest, const Kernel *kernel, const RippleMap *map = nullptr,
+                    unsigned int tile_size = 64, ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Convolute all color channels of the padded image \p src with the kernel \p kernel, one destination tile at a
+ * time.
+ *
+ * The halo of \p src must be at least half the kernel size, such that the kernel is applied without any bounds checks
+ * or scratch copies. With a zero halo, the result is identical to that of convolute(). With a replicated halo, edge
+ * pixels are repeated instead.
+ *
+ * @param src       The padded source image.
+ * @param dest      The destination image.
+ * @param kernel    The convolution kernel.
+ * @param tile_size The width and height of the destination tiles.
+ * @param pool      The thread pool that processes the tiles.
+ */
+void convolutePadded(const PaddedImage *src, Image *dest, const Kernel *kernel, unsigned int tile_size = 64,
+                     ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Obtain the histogram of all channels of \p src, computing partial histograms of row bands concurrently.
+ *
+ * The result is identical to that of getHistogram().
+ *
+ * @param src       The source image.
+ * @param pool      The thread pool that processes the row bands.
+ * @return          The histogram.
+ */
+Histogram getHistogramCPU(const Image *src, ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Enhance the contrast of the red, green and blue channels of \p src, and copy its alpha channel.
+ *
+ * The result is identical to that of calling enhanceContrastLinearly() on channels 0, 1 and 2 and copyChannel() on
+ * channel 3, but every pixel is only visited once, through a lookup table per channel.
+ *
+ * @param src       The source image.
+ * @param src_hist  The histogram of the source image.
+ * @param dest      The destination image.
+ * @param low       Threshold for lower intensities.
+ * @param high      Threshold for higher intensities.
+ * @param pool      The thread pool that processes the row bands.
+ */
+void enhanceContrastLinearlyCPU(const Image *src, const Histogram *src_hist, Image *dest, Histogram::Count low,
+                                Histogram::Count high, ThreadPool *pool = &ThreadPool::instance());
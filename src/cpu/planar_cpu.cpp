@@ -0,0 +1,349 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "../baseline/imgproc.hpp"
+#include "../utils/ImagePool.hpp"
+#include "../utils/ImageWriter.hpp"
+#include "../utils/StageGraph.hpp"
+
+#include "imgproc_cpu.hpp"
+#include "planar_cpu.hpp"
+
+/// @brief Number of pixels per task of the per-pixel stages.
+static const size_t band_pixels = 64 * 1024;
+
+///@brief Check if the dimensions of two planar images are equal, or throw a domain error.
+static inline void checkDimensionsEqualOrThrow(const PlanarImage *a, const PlanarImage *b) {
+  assert(a != nullptr);
+  assert(b != nullptr);
+  if ((a->width != b->width) || (a->height != b->height)) {
+    throw std::domain_error("Source and destination image are not of equal dimensions.");
+  }
+}
+
+///@brief Check if the dimensions of a planar image and a ripple map are equal, or throw a domain error.
+static inline void checkMapDimensionsOrThrow(const PlanarImage *src, const RippleMap *map) {
+  if ((map != nullptr) && ((map->width != src->width) || (map->height != src->height))) {
+    throw std::domain_error("Source image and ripple map are not of equal dimensions.");
+  }
+}
+
+Histogram getHistogramPlanar(const PlanarImage *src, ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (pool != nullptr));
+
+  // Count every band of every plane into its own part of a histogram, and sum them up. Every band only touches one
+  // channel of the histogram, so counting a plane has no dependency between subsequent channels of a pixel.
+  Histogram hist;
+  const size_t size = hist.values.size();
+  const size_t range = hist.range;
+  const size_t bands = (src->size() + band_pixels - 1) / band_pixels;
+  hist.values = pool->parallelReduce(
+      0, bands * 4, 1, std::vector<Histogram::Count>(size, 0),
+      [&](size_t i, size_t) {
+        std::vector<Histogram::Count> band(size, 0);
+        const int c = (int) (i / bands);
+        const size_t begin = (i % bands) * band_pixels;
+        const size_t end = std::min(src->size(), begin + band_pixels);
+        const unsigned char *p = src->plane(c);
+        Histogram::Count *counts = band.data() + c * range;
+        for (size_t j = begin; j < end; j++) {
+          counts[p[j]]++;
+        }
+        return band;
+      },
+      [&](std::vector<Histogram::Count> a, const std::vector<Histogram::Count> &b) {
+        for (size_t i = 0; i < size; i++) {
+          a[i] += b[i];
+        }
+        return a;
+      });
+
+  return hist;
+}
+
+void enhanceContrastLinearlyPlanar(const PlanarImage *src, const Histogram *src_hist, PlanarImage *dest,
+                                   Histogram::Count low, Histogram::Count high, ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (src_hist != nullptr) && (dest != nullptr) && (pool != nullptr));
+  checkDimensionsEqualOrThrow(src, dest);
+
+  // Map the color planes through their lookup tables and copy the alpha plane.
+  const Lut luts[3] = {getContrastLut(src_hist, low, high, 0), getContrastLut(src_hist, low, high, 1),
+                       getContrastLut(src_hist, low, high, 2)};
+
+  pool->parallelFor(0, src->size(), band_pixels, [&](size_t begin, size_t end) {
+    for (int c = 0; c < 3; c++) {
+      const Lut lut = luts[c];
+      const unsigned char *in = src->plane(c);
+      unsigned char *out = dest->plane(c);
+      for (size_t i = begin; i < end; i++) {
+        out[i] = lut(in[i]);
+      }
+    }
+    std::memcpy(dest->plane(3) + begin, src->plane(3) + begin, end - begin);
+  });
+}
+
+void applyRippleMapPlanar(const PlanarImage *src, PlanarImage *dest, const RippleMap *map, ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr) && (map != nullptr) && (pool != nullptr));
+  checkDimensionsEqualOrThrow(src, dest);
+  checkMapDimensionsOrThrow(src, map);
+
+  const std::uint32_t *index = map->index.data();
+  pool->parallelFor(0, src->size(), band_pixels, [&](size_t begin, size_t end) {
+    for (int c = 0; c < 4; c++) {
+      const unsigned char *in = src->plane(c);
+      unsigned char *out = dest->plane(c);
+      for (size_t i = begin; i < end; i++) {
+        const std::uint32_t s = index[i];
+        out[i] = (s == RippleMap::transparent) ? 0 : in[s];
+      }
+    }
+  });
+}
+
+/**
+ * @brief Fill \p scratch with the values of plane \p c of the rectangle [x0, x0 + sw) x [y0, y0 + sh).
+ *
+ * Values outside of the image are zero. If \p index is not null, the values are gathered through the ripple map index.
+ */
+static void fillPlaneScratch(const PlanarImage *src, int c, const std::uint32_t *index, unsigned char *scratch,
+                             int x0, int y0, int sw, int sh) {
+  const int width = src->width;
+  const int height = src->height;
+  const unsigned char *plane = src->plane(c);
+
+  for (int sy = 0; sy < sh; sy++) {
+    const int y = y0 + sy;
+    unsigned char *row = scratch + (size_t) sy * sw;
+
+    if ((y < 0) || (y >= height)) {
+      std::fill(row, row + sw, 0);
+      continue;
+    }
+
+    for (int sx = 0; sx < sw; sx++) {
+      const int x = x0 + sx;
+      if ((x < 0) || (x >= width)) {
+        row[sx] = 0;
+      } else if (index == nullptr) {
+        row[sx] = plane[(size_t) y * width + x];
+      } else {
+        const std::uint32_t i = index[(size_t) y * width + x];
+        row[sx] = (i == RippleMap::transparent) ? 0 : plane[i];
+      }
+    }
+  }
+}
+
+void convolutePlanar(const PlanarImage *src, PlanarImage *dest, const Kernel *kernel, const RippleMap *map,
+                     unsigned int tile_size, ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr) && (kernel != nullptr) && (pool != nullptr));
+  checkDimensionsEqualOrThrow(src, dest);
+  checkMapDimensionsOrThrow(src, map);
+  if (tile_size == 0) {
+    throw std::domain_error("Tile size must be positive.");
+  }
+
+  const int hx = kernel->width / 2;
+  const int hy = kernel->height / 2;
+  const size_t width = src->width;
+  const std::uint32_t *index = (map == nullptr) ? nullptr : map->index.data();
+
+  // For every destination tile
+  pool->parallelFor2D(src->width, src->height, tile_size, tile_size, [&](int tx, int x1, int ty, int y1) {
+    const int tw = x1 - tx;
+    const int th = y1 - ty;
+    const int sw = tw + 2 * hx;
+    const int sh = th + 2 * hy;
+
+    // Scratch buffer holding one plane of a tile plus its halo, reused for all planes and tiles of this thread.
+    thread_local std::vector<unsigned char> scratch;
+    scratch.resize((size_t) sw * sh);
+
+    for (int c = 0; c < 4; c++) {
+      fillPlaneScratch(src, c, index, scratch.data(), tx - hx, ty - hy, sw, sh);
+      unsigned char *out = dest->plane(c);
+
+      // Convolute the tile, accumulating in the same order as convoluteTiled() does.
+      for (int y = 0; y < th; y++) {
+        for (int x = 0; x < tw; x++) {
+          double v = 0.0;
+          for (int ky = -hy; ky <= hy; ky++) {
+            const unsigned char *row = scratch.data() + (size_t) (y + hy + ky) * sw + (x + hx);
+            for (int kx = -hx; kx <= hx; kx++) {
+              v += (float) row[kx] * kernel->weight(kx, ky);
+            }
+          }
+          out[(ty + y) * width + tx + x] = (unsigned char) (v * kernel->scale);
+        }
+      }
+    }
+  });
+}
+
+std::shared_ptr<Image> runWaterEffectPlanar(const Image *src, const WaterEffectOptions *options, SimdLevel level,
+                                            ThreadPool *pool) {
+  if (options->enhance && !options->histogram) {
+    throw std::runtime_error("Cannot run enhance stage without histogram.");
+  }
+
+  StageGraph graph;
+  ImagePool &images = ImagePool::instance();
+  ImageWriter &writer = ImageWriter::instance();
+
+  // Planar intermediate results. Every one of them is produced by a single stage, and only read by its dependents.
+  std::shared_ptr<PlanarImage> planar;
+  std::shared_ptr<Histogram> hist;
+  std::shared_ptr<PlanarImage> img_enhanced;
+  std::shared_ptr<PlanarImage> img_rippled;
+  std::shared_ptr<PlanarImage> img_blurred;
+  std::shared_ptr<const RippleMap> map;
+
+  // The latest planar image of the pipeline, and the stage producing it.
+  std::shared_ptr<PlanarImage> *img_result = nullptr;
+  std::vector<size_t> result_stage;
+  std::shared_ptr<Image> result;
+
+  // Convert a planar image back to an interleaved one, which is only done for output.
+  auto toInterleaved = [&](const PlanarImage *img) {
+    auto out = images.acquire(img->width, img->height);
+    interleave(img, out.get(), level, pool);
+    return out;
+  };
+  auto save = [&](const PlanarImage *img, const std::string &suffix) {
+    writer.write(toInterleaved(img), options->outputFile(suffix));
+  };
+  auto allocate = [src]() { return std::make_shared<PlanarImage>(src->width, src->height); };
+
+  // Histogram stage, which is the only stage that reads the interleaved source image directly.
+  size_t histogram_stage = 0;
+  if (options->histogram) {
+    histogram_stage = graph.add("Histogram", [&]() {
+      hist = std::make_shared<Histogram>(getHistogramCPU(src, pool));
+      if (options->save_intermediate) {
+        writer.write(hist->toImage(), options->outputFile("_histogram"));
+      }
+    });
+  }
+
+  // All other stages read the source image in planar layout.
+  size_t deinterleave_stage = 0;
+  if (options->enhance || options->ripple || options->blur) {
+    deinterleave_stage = graph.add("Deinterleave", [&]() {
+      planar = allocate();
+      deinterleave(src, planar.get(), level, pool);
+    });
+    img_result = &planar;
+    result_stage = {deinterleave_stage};
+  }
+
+  // Contrast enhancement stage
+  if (options->enhance) {
+    const size_t enhance_stage = graph.add("Contrast enhance", [&]() {
+      // Determine the threshold from the histogram, by taking 10% of the maximum value in the histogram.
+      auto threshold = (Histogram::Count) (hist->max(0) * 0.1);
+
+      img_enhanced = allocate();
+      enhanceContrastLinearlyPlanar(planar.get(), hist.get(), img_enhanced.get(), threshold, threshold, pool);
+      planar.reset();
+      if (options->save_intermediate) {
+        save(img_enhanced.get(), "_enhanced");
+      }
+    }, {histogram_stage, deinterleave_stage});
+
+    // Create and save the enhanced histogram (if enabled).
+    if (options->enhance_hist) {
+      graph.add("Enhanced histogram", [&]() {
+        auto enhanced_hist = getHistogramPlanar(img_enhanced.get(), pool);
+        writer.write(enhanced_hist.toImage(),
+                     options->outputFile("_enhanced_histogram"));
+      }, {enhance_stage}, false);
+    }
+
+    img_result = &img_enhanced;
+    result_stage = {enhance_stage};
+  }
+
+  if (options->ripple) {
+    // The ripple map only depends on the image geometry, so it is obtained concurrently with the previous stages.
+    const size_t map_stage = graph.add("Ripple map", [&]() {
+      map = getRippleMap(src->width, src->height, options->ripple_frequency, options->ripple_map_step, level, pool);
+    });
+    auto dependencies = result_stage;
+    dependencies.push_back(map_stage);
+    auto in = img_result;
+
+    if (options->blur && !options->save_intermediate) {
+      // Fused ripple effect and Gaussian blur stage. The rippled image is never materialized.
+      const size_t blur_stage = graph.add("Ripple + blur", [&, in]() {
+        auto gaussian = getGaussianKernel(options->blur_size);
+        img_blurred = allocate();
+        convolutePlanar(in->get(), img_blurred.get(), gaussian.get(), map.get(), 64, pool);
+      }, dependencies);
+
+      img_result = &img_blurred;
+      result_stage = {blur_stage};
+    } else {
+      // Ripple effect stage, which is just a gather through the map.
+      const size_t ripple_stage = graph.add("Ripple effect", [&, in]() {
+        img_rippled = allocate();
+        applyRippleMapPlanar(in->get(), img_rippled.get(), map.get(), pool);
+        if (options->save_intermediate) {
+          save(img_rippled.get(), "_rippled");
+        }
+      }, dependencies);
+
+      img_result = &img_rippled;
+      result_stage = {ripple_stage};
+    }
+  }
+
+  // Gaussian blur stage, unless it was fused with the ripple effect
+  if (options->blur && (img_result != &img_blurred)) {
+    auto in = img_result;
+    const size_t blur_stage = graph.add("Blur", [&, in]() {
+      auto gaussian = getGaussianKernel(options->blur_size);
+      img_blurred = allocate();
+      convolutePlanar(in->get(), img_blurred.get(), gaussian.get(), nullptr, 64, pool);
+      if (options->save_intermediate) {
+        save(img_blurred.get(), "_blurred");
+      }
+    }, result_stage);
+
+    img_result = &img_blurred;
+    result_stage = {blur_stage};
+  }
+
+  // Convert the result back to an interleaved image, if any stage produced one.
+  if (img_result != nullptr) {
+    graph.add("Interleave", [&]() { result = toInterleaved(img_result->get()); }, result_stage);
+  }
+
+  graph.execute(pool);
+  if (options->report_stages) {
+    graph.report();
+  }
+
+  return result;
+}
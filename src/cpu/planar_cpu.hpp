@@ -0,0 +1,99 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <memory>
+
+#include "../baseline/water.hpp"
+#include "../utils/Histogram.hpp"
+#include "../utils/Kernel.hpp"
+#include "../utils/PlanarImage.hpp"
+#include "../utils/ThreadPool.hpp"
+
+#include "ripple_cpu.hpp"
+
+/**
+ * @brief Obtain the histogram of all planes of \p src, counting bands of every plane concurrently.
+ *
+ * The result is identical to that of getHistogram() on the interleaved image.
+ *
+ * @param src       The source image.
+ * @param pool      The thread pool that processes the bands.
+ * @return          The histogram.
+ */
+Histogram getHistogramPlanar(const PlanarImage *src, ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Enhance the contrast of the red, green and blue planes of \p src, and copy its alpha plane.
+ *
+ * The result is identical to that of enhanceContrastLinearlyCPU() on the interleaved image.
+ *
+ * @param src       The source image.
+ * @param src_hist  The histogram of the source image.
+ * @param dest      The destination image.
+ * @param low       Threshold for lower intensities.
+ * @param high      Threshold for higher intensities.
+ * @param pool      The thread pool that processes the bands.
+ */
+void enhanceContrastLinearlyPlanar(const PlanarImage *src, const Histogram *src_hist, PlanarImage *dest,
+                                   Histogram::Count low, Histogram::Count high,
+                                   ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Apply a ripple effect to \p src using a precomputed ripple map, gathering every plane with the same index.
+ *
+ * The result is identical to that of applyRippleMap() on the interleaved image.
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param map       The ripple map. Its dimensions must match those of the images.
+ * @param pool      The thread pool that processes the bands.
+ */
+void applyRippleMapPlanar(const PlanarImage *src, PlanarImage *dest, const RippleMap *map,
+                          ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Convolute all planes of \p src with the kernel \p kernel, one destination tile at a time.
+ *
+ * Like convoluteTiled(), every tile and its halo are first copied into a thread-local scratch buffer, optionally
+ * gathering through a ripple map, but one plane at a time. The result is identical to that of convoluteTiled().
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param kernel    The convolution kernel.
+ * @param map       An optional ripple map to apply to \p src before convoluting.
+ * @param tile_size The width and height of the destination tiles.
+ * @param pool      The thread pool that processes the tiles.
+ */
+void convolutePlanar(const PlanarImage *src, PlanarImage *dest, const Kernel *kernel, const RippleMap *map = nullptr,
+                     unsigned int tile_size = 64, ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Run the water effect on planar data.
+ *
+ * The source image is converted to a planar image once. All stages then run on planar images, and only the result
+ * and saved intermediate images are converted back to interleaved images. The result is identical to that of
+ * runWaterEffectCPU().
+ *
+ * @param src       The source image.
+ * @param options   The options of the effect.
+ * @param level     The SIMD level of the layout conversions and the ripple map.
+ * @param pool      The thread pool to run the stages with.
+ * @return          The resulting image, or nullptr if no stage produces an image.
+ */
+std::shared_ptr<Image> runWaterEffectPlanar(const Image *src, const WaterEffectOptions *options,
+                                            SimdLevel level = detectSimdLevel(),
+                                            ThreadPool *pool = &ThreadPool::instance());
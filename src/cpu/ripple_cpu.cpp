@@ -0,0 +1,886 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "ripple_cpu.hpp"
+
+/// @brief Maximum number of ripple maps kept in the process-wide cache.
+static const size_t ripple_map_cache_capacity = 8;
+
+/// @brief Number of destination rows ahead of which the tiled gather prefetches source pixels.
+static const int ripple_prefetch_rows = 2;
+
+/// @brief Horizontal distance in destination pixels between prefetches of the tiled gather.
+static const int ripple_prefetch_stride = 8;
+
+/// @brief Number of rows per task when computing a ripple map.
+static const size_t ripple_band_rows = 32;
+
+/// @brief A least-recently-used cache of ripple maps, keyed by geometry, frequency, grid step and SIMD level.
+struct RippleMapCache {
+  std::mutex mutex;
+  std::list<std::shared_ptr<const RippleMap>> maps;
+
+  static RippleMapCache &instance() {
+    static RippleMapCache cache;
+    return cache;
+  }
+};
+
+/// @brief Compare frequencies by their bit pattern, such that a cache hit always yields an identical map.
+static inline bool sameFrequency(float a, float b) {
+  return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+/**
+ * @brief Minimax coefficients for sin(r) = r + r^3 * (c1 + r^2 * (c2 + r^2 * (c3 + r^2 * c4))) on [-pi/2, pi/2].
+ *
+ * The maximum absolute error of this approximation is about 5e-9, well below single precision resolution.
+ */
+static const float sin_c1 = -1.666665673e-01f;
+static const float sin_c2 = 8.333017118e-03f;
+static const float sin_c3 = -1.980661473e-04f;
+static const float sin_c4 = 2.600054813e-06f;
+
+static const float pi_f = 3.14159265358979f;
+static const float inv_pi_f = 0.318309886183791f;
+
+/**
+ * @brief Constants of the transcendental-free ripple formula for one geometry and frequency.
+ *
+ * The baseline computes angle = atan2(ny, nx) and then cos(angle) and sin(angle), but those are just nx / dist and
+ * ny / dist. What remains is src_dist = sin^2(dist * pi / 2 * frequency), for which we use a polynomial. Since sin^2
+ * has period pi, the argument is reduced to [-pi/2, pi/2] without having to track the sign.
+ */
+struct RippleParams {
+  RippleParams(unsigned int width, unsigned int height, float frequency)
+      : width(width), height(height),
+        x_scale(2.0f / width), y_scale(2.0f / height),
+        half_width(0.5f * width), half_height(0.5f * height),
+        k((float) (M_PI / 2.0) * frequency) {}
+
+  unsigned int width;
+  unsigned int height;
+  float x_scale;
+  float y_scale;
+  float half_width;
+  float half_height;
+  float k;
+};
+
+/// @brief Return sin^2(t), clamped to 1 such that polynomial error never makes a pixel transparent.
+static inline float sinSquared(float t) {
+  float q = std::floor(t * inv_pi_f + 0.5f);
+  float r = t - q * pi_f;
+  float r2 = r * r;
+  float s = r + r * r2 * (sin_c1 + r2 * (sin_c2 + r2 * (sin_c3 + r2 * sin_c4)));
+  return std::min(s * s, 1.0f);
+}
+
+/// @brief Return the source pixel index for normalized lensed source coordinate (\p lx, \p ly).
+static inline std::uint32_t lensedIndex(const RippleParams &p, float lx, float ly) {
+  auto sx = (int) ((lx + 1.0f) * p.half_width);
+  auto sy = (int) ((ly + 1.0f) * p.half_height);
+
+  if (((unsigned int) sx >= p.width) || ((unsigned int) sy >= p.height)) {
+    return RippleMap::transparent;
+  }
+  return (std::uint32_t) sy * p.width + (std::uint32_t) sx;
+}
+
+/// @brief Return the source pixel index for normalized destination coordinate (\p nx, \p ny).
+static inline std::uint32_t rippleIndex(const RippleParams &p, float nx, float ny) {
+  float dist = std::sqrt(nx * nx + ny * ny);
+  float src_dist = sinSquared(dist * p.k);
+
+  // Scale the unit direction (nx, ny) / dist by the lensed distance. In the center the direction is undefined, but
+  // src_dist is zero there anyway.
+  float g = dist > 0.0f ? src_dist / dist : 0.0f;
+
+  return lensedIndex(p, g * nx, g * ny);
+}
+
+/// @brief Scalar ripple kernel. Gathers into \p out if \p Gather is set, or stores source indices in \p index.
+template<bool Gather>
+static void rippleRowsScalar(const RippleParams &p, const Pixel *in, Pixel *out, std::uint32_t *index,
+                             int x0, int x1, int y) {
+  float ny = -1.0f + y * p.y_scale;
+  for (int x = x0; x < x1; x++) {
+    float nx = -1.0f + x * p.x_scale;
+    auto i = rippleIndex(p, nx, ny);
+    size_t o = (size_t) y * p.width + x;
+    if (Gather) {
+      out[o] = (i == RippleMap::transparent) ? Pixel{0, 0, 0, 0} : in[i];
+    } else {
+      index[o] = i;
+    }
+  }
+}
+
+#ifdef USE_X86_SIMD
+
+/// @brief AVX2 version of sinSquared().
+__attribute__((target("avx2,fma")))
+static inline __m256 sinSquaredAVX2(__m256 t) {
+  __m256 q = _mm256_round_ps(_mm256_mul_ps(t, _mm256_set1_ps(inv_pi_f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(q, _mm256_set1_ps(pi_f), t);
+  __m256 r2 = _mm256_mul_ps(r, r);
+  __m256 poly = _mm256_fmadd_ps(r2, _mm256_set1_ps(sin_c4), _mm256_set1_ps(sin_c3));
+  poly = _mm256_fmadd_ps(r2, poly, _mm256_set1_ps(sin_c2));
+  poly = _mm256_fmadd_ps(r2, poly, _mm256_set1_ps(sin_c1));
+  __m256 sn = _mm256_fmadd_ps(_mm256_mul_ps(r, r2), poly, r);
+  return _mm256_min_ps(_mm256_mul_ps(sn, sn), _mm256_set1_ps(1.0f));
+}
+
+/// @brief AVX2 version of lensedIndex().
+__attribute__((target("avx2,fma")))
+static inline __m256i lensedIndexAVX2(const RippleParams &p, __m256 lx, __m256 ly) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  __m256i sx = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_add_ps(lx, one), _mm256_set1_ps(p.half_width)));
+  __m256i sy = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_add_ps(ly, one), _mm256_set1_ps(p.half_height)));
+
+  // Bounds check, negative coordinates included
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i w = _mm256_set1_epi32((int) p.width);
+  const __m256i h = _mm256_set1_epi32((int) p.height);
+  __m256i valid = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(sx, minus_one), _mm256_cmpgt_epi32(w, sx)),
+                                   _mm256_and_si256(_mm256_cmpgt_epi32(sy, minus_one), _mm256_cmpgt_epi32(h, sy)));
+
+  __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(sy, w), sx);
+  return _mm256_blendv_epi8(minus_one, idx, valid);
+}
+
+/// @brief AVX2 version of rippleIndex() for 8 horizontally adjacent pixels.
+__attribute__((target("avx2,fma")))
+static inline __m256i rippleIndexAVX2(const RippleParams &p, __m256 nx, __m256 ny) {
+  __m256 dist = _mm256_sqrt_ps(_mm256_fmadd_ps(nx, nx, _mm256_mul_ps(ny, ny)));
+  __m256 src_dist = sinSquaredAVX2(_mm256_mul_ps(dist, _mm256_set1_ps(p.k)));
+
+  // Lensed direction, zero in the center where 0 / 0 would give NaN
+  __m256 g = _mm256_and_ps(_mm256_div_ps(src_dist, dist), _mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+  return lensedIndexAVX2(p, _mm256_mul_ps(g, nx), _mm256_mul_ps(g, ny));
+}
+
+/// @brief Gather 8 pixels, or make them transparent where the index is RippleMap::transparent.
+__attribute__((target("avx2,fma")))
+static inline __m256i gatherAVX2(const Pixel *in, __m256i idx) {
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  __m256i valid = _mm256_xor_si256(_mm256_cmpeq_epi32(idx, minus_one), minus_one);
+  return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *) in, idx, valid, 4);
+}
+
+/// @brief Convert lensed coordinates to source indices, 8 at a time. Returns the number of converted coordinates.
+__attribute__((target("avx2,fma")))
+static int lensedIndicesAVX2(const RippleParams &p, const float *lx, const float *ly, std::uint32_t *index, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i idx = lensedIndexAVX2(p, _mm256_loadu_ps(lx + i), _mm256_loadu_ps(ly + i));
+    _mm256_storeu_si256((__m256i *) (index + i), idx);
+  }
+  return i;
+}
+
+/// @brief AVX2 ripple kernel.
+template<bool Gather>
+__attribute__((target("avx2,fma")))
+static void rippleRowsAVX2(const RippleParams &p, const Pixel *in, Pixel *out, std::uint32_t *index,
+                           int x0, int x1, int y) {
+  const __m256 iota = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+  const __m256 ny = _mm256_set1_ps(-1.0f + y * p.y_scale);
+
+  int x = x0;
+  for (; x + 8 <= x1; x += 8) {
+    __m256 nx = _mm256_fmsub_ps(_mm256_add_ps(_mm256_set1_ps((float) x), iota), _mm256_set1_ps(p.x_scale),
+                                _mm256_set1_ps(1.0f));
+    __m256i idx = rippleIndexAVX2(p, nx, ny);
+    size_t o = (size_t) y * p.width + x;
+    if (Gather) {
+      _mm256_storeu_si256((__m256i *) (out + o), gatherAVX2(in, idx));
+    } else {
+      _mm256_storeu_si256((__m256i *) (index + o), idx);
+    }
+  }
+  rippleRowsScalar<Gather>(p, in, out, index, x, x1, y);
+}
+
+/// @brief AVX-512 version of sinSquared().
+__attribute__((target("avx512f")))
+static inline __m512 sinSquaredAVX512(__m512 t) {
+  __m512 q = _mm512_roundscale_ps(_mm512_mul_ps(t, _mm512_set1_ps(inv_pi_f)), _MM_FROUND_TO_NEAREST_INT);
+  __m512 r = _mm512_fnmadd_ps(q, _mm512_set1_ps(pi_f), t);
+  __m512 r2 = _mm512_mul_ps(r, r);
+  __m512 poly = _mm512_fmadd_ps(r2, _mm512_set1_ps(sin_c4), _mm512_set1_ps(sin_c3));
+  poly = _mm512_fmadd_ps(r2, poly, _mm512_set1_ps(sin_c2));
+  poly = _mm512_fmadd_ps(r2, poly, _mm512_set1_ps(sin_c1));
+  __m512 sn = _mm512_fmadd_ps(_mm512_mul_ps(r, r2), poly, r);
+  return _mm512_min_ps(_mm512_mul_ps(sn, sn), _mm512_set1_ps(1.0f));
+}
+
+/// @brief AVX-512 version of lensedIndex().
+__attribute__((target("avx512f")))
+static inline __m512i lensedIndexAVX512(const RippleParams &p, __m512 lx, __m512 ly) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  __m512i sx = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_add_ps(lx, one), _mm512_set1_ps(p.half_width)));
+  __m512i sy = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_add_ps(ly, one), _mm512_set1_ps(p.half_height)));
+
+  // Bounds check, an unsigned compare also rejects negative coordinates
+  __mmask16 valid = _mm512_cmplt_epu32_mask(sx, _mm512_set1_epi32((int) p.width))
+                    & _mm512_cmplt_epu32_mask(sy, _mm512_set1_epi32((int) p.height));
+
+  __m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(sy, _mm512_set1_epi32((int) p.width)), sx);
+  return _mm512_mask_blend_epi32(valid, _mm512_set1_epi32(-1), idx);
+}
+
+/// @brief AVX-512 version of rippleIndex() for 16 horizontally adjacent pixels.
+__attribute__((target("avx512f")))
+static inline __m512i rippleIndexAVX512(const RippleParams &p, __m512 nx, __m512 ny) {
+  __m512 dist = _mm512_sqrt_ps(_mm512_fmadd_ps(nx, nx, _mm512_mul_ps(ny, ny)));
+  __m512 src_dist = sinSquaredAVX512(_mm512_mul_ps(dist, _mm512_set1_ps(p.k)));
+
+  // Lensed direction, zero in the center where 0 / 0 would give NaN
+  __mmask16 center = _mm512_cmp_ps_mask(dist, _mm512_setzero_ps(), _CMP_GT_OQ);
+  __m512 g = _mm512_maskz_div_ps(center, src_dist, dist);
+
+  return lensedIndexAVX512(p, _mm512_mul_ps(g, nx), _mm512_mul_ps(g, ny));
+}
+
+/// @brief Gather 16 pixels, or make them transparent where the index is RippleMap::transparent.
+__attribute__((target("avx512f")))
+static inline __m512i gatherAVX512(const Pixel *in, __m512i idx) {
+  __mmask16 valid = _mm512_cmpneq_epi32_mask(idx, _mm512_set1_epi32(-1));
+  return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), valid, idx, in, 4);
+}
+
+/// @brief Convert lensed coordinates to source indices, 16 at a time. Returns the number of converted coordinates.
+__attribute__((target("avx512f")))
+static int lensedIndicesAVX512(const RippleParams &p, const float *lx, const float *ly, std::uint32_t *index, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_si512(index + i, lensedIndexAVX512(p, _mm512_loadu_ps(lx + i), _mm512_loadu_ps(ly + i)));
+  }
+  return i;
+}
+
+/// @brief AVX-512 ripple kernel.
+template<bool Gather>
+__attribute__((target("avx512f")))
+static void rippleRowsAVX512(const RippleParams &p, const Pixel *in, Pixel *out, std::uint32_t *index,
+                             int x0, int x1, int y) {
+  const __m512 iota = _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f,
+                                     8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+  const __m512 ny = _mm512_set1_ps(-1.0f + y * p.y_scale);
+
+  int x = x0;
+  for (; x + 16 <= x1; x += 16) {
+    __m512 nx = _mm512_fmsub_ps(_mm512_add_ps(_mm512_set1_ps((float) x), iota), _mm512_set1_ps(p.x_scale),
+                                _mm512_set1_ps(1.0f));
+    __m512i idx = rippleIndexAVX512(p, nx, ny);
+    size_t o = (size_t) y * p.width + x;
+    if (Gather) {
+      _mm512_storeu_si512(out + o, gatherAVX512(in, idx));
+    } else {
+      _mm512_storeu_si512(index + o, idx);
+    }
+  }
+  rippleRowsScalar<Gather>(p, in, out, index, x, x1, y);
+}
+
+#endif
+
+/**
+ * @brief Run the ripple kernel of some SIMD level on the rectangle [x0, x1) x [y0, y1).
+ *
+ * Gathers pixels from \p in into \p out, or, if \p index is not null, stores the source indices in \p index.
+ */
+static void rippleRect(const RippleParams &p, SimdLevel level, const Pixel *in, Pixel *out, std::uint32_t *index,
+                       int x0, int x1, int y0, int y1) {
+  // The SIMD gathers use signed 32-bit indices.
+  if ((size_t) p.width * p.height > (size_t) std::numeric_limits<int>::max()) {
+    level = SimdLevel::Scalar;
+  }
+  level = std::min(level, detectSimdLevel());
+
+  for (int y = y0; y < y1; y++) {
+    switch (level) {
+#ifdef USE_X86_SIMD
+      case SimdLevel::AVX512:
+        if (index != nullptr) rippleRowsAVX512<false>(p, in, out, index, x0, x1, y);
+        else rippleRowsAVX512<true>(p, in, out, index, x0, x1, y);
+        break;
+      case SimdLevel::AVX2:
+        if (index != nullptr) rippleRowsAVX2<false>(p, in, out, index, x0, x1, y);
+        else rippleRowsAVX2<true>(p, in, out, index, x0, x1, y);
+        break;
+#endif
+      default:
+        if (index != nullptr) rippleRowsScalar<false>(p, in, out, index, x0, x1, y);
+        else rippleRowsScalar<true>(p, in, out, index, x0, x1, y);
+        break;
+    }
+  }
+}
+
+/// @brief Convert \p n lensed coordinates to source indices, using SIMD level \p level.
+static void lensedIndices(const RippleParams &params, SimdLevel level, const float *lx, const float *ly,
+                          std::uint32_t *index, int n) {
+  // Copy the parameters, such that the compiler knows they do not alias with the indices.
+  const RippleParams p = params;
+  int i = 0;
+#ifdef USE_X86_SIMD
+  if (std::min(level, detectSimdLevel()) == SimdLevel::AVX512) {
+    i = lensedIndicesAVX512(p, lx, ly, index, n);
+  } else if (std::min(level, detectSimdLevel()) == SimdLevel::AVX2) {
+    i = lensedIndicesAVX2(p, lx, ly, index, n);
+  }
+#endif
+  for (; i < n; i++) {
+    index[i] = lensedIndex(p, lx[i], ly[i]);
+  }
+}
+
+/// @brief Scalar polar ripple kernel on the linear pixel range [begin, end).
+static void polarRangeScalar(const RippleParams &p, const RipplePolarMap *polar, const Pixel *in, Pixel *out,
+                             size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    float src_dist = sinSquared(polar->radius[i] * p.k);
+    auto s = lensedIndex(p, src_dist * polar->dir_x[i], src_dist * polar->dir_y[i]);
+    out[i] = (s == RippleMap::transparent) ? Pixel{0, 0, 0, 0} : in[s];
+  }
+}
+
+#ifdef USE_X86_SIMD
+
+/// @brief AVX2 polar ripple kernel.
+__attribute__((target("avx2,fma")))
+static void polarRangeAVX2(const RippleParams &p, const RipplePolarMap *polar, const Pixel *in, Pixel *out,
+                           size_t begin, size_t end) {
+  const __m256 k = _mm256_set1_ps(p.k);
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 src_dist = sinSquaredAVX2(_mm256_mul_ps(_mm256_loadu_ps(&polar->radius[i]), k));
+    __m256i idx = lensedIndexAVX2(p,
+                                  _mm256_mul_ps(src_dist, _mm256_loadu_ps(&polar->dir_x[i])),
+                                  _mm256_mul_ps(src_dist, _mm256_loadu_ps(&polar->dir_y[i])));
+    _mm256_storeu_si256((__m256i *) (out + i), gatherAVX2(in, idx));
+  }
+  polarRangeScalar(p, polar, in, out, i, end);
+}
+
+/// @brief AVX-512 polar ripple kernel.
+__attribute__((target("avx512f")))
+static void polarRangeAVX512(const RippleParams &p, const RipplePolarMap *polar, const Pixel *in, Pixel *out,
+                             size_t begin, size_t end) {
+  const __m512 k = _mm512_set1_ps(p.k);
+  size_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    __m512 src_dist = sinSquaredAVX512(_mm512_mul_ps(_mm512_loadu_ps(&polar->radius[i]), k));
+    __m512i idx = lensedIndexAVX512(p,
+                                    _mm512_mul_ps(src_dist, _mm512_loadu_ps(&polar->dir_x[i])),
+                                    _mm512_mul_ps(src_dist, _mm512_loadu_ps(&polar->dir_y[i])));
+    _mm512_storeu_si512(out + i, gatherAVX512(in, idx));
+  }
+  polarRangeScalar(p, polar, in, out, i, end);
+}
+
+#endif
+
+/// @brief Run the polar ripple kernel of some SIMD level on the linear pixel range [begin, end).
+static void polarRange(const RippleParams &p, SimdLevel level, const RipplePolarMap *polar, const Pixel *in,
+                       Pixel *out, size_t begin, size_t end) {
+  // The SIMD gathers use signed 32-bit indices.
+  if ((size_t) p.width * p.height > (size_t) std::numeric_limits<int>::max()) {
+    level = SimdLevel::Scalar;
+  }
+  switch (std::min(level, detectSimdLevel())) {
+#ifdef USE_X86_SIMD
+    case SimdLevel::AVX512: polarRangeAVX512(p, polar, in, out, begin, end);
+      break;
+    case SimdLevel::AVX2: polarRangeAVX2(p, polar, in, out, begin, end);
+      break;
+#endif
+    default: polarRangeScalar(p, polar, in, out, begin, end);
+      break;
+  }
+}
+
+std::shared_ptr<RippleMap> RippleMap::create(unsigned int width, unsigned int height, float frequency,
+                                             SimdLevel level, ThreadPool *pool) {
+  assert(pool != nullptr);
+  if ((size_t) width * height >= RippleMap::transparent) {
+    throw std::domain_error("Image too large for a ripple map.");
+  }
+
+  auto map = std::make_shared<RippleMap>();
+  map->width = width;
+  map->height = height;
+  map->frequency = frequency;
+  map->level = std::min(level, detectSimdLevel());
+  map->index.resize((size_t) width * height);
+
+  // For every destination pixel, store the source pixel index
+  RippleParams params(width, height, frequency);
+  pool->parallelFor(0, height, ripple_band_rows, [&](size_t y0, size_t y1) {
+    rippleRect(params, level, nullptr, nullptr, map->index.data(), 0, width, y0, y1);
+  });
+
+  return map;
+}
+
+/// @brief Obtain the lensed normalized source coordinate (\p lx, \p ly) of destination pixel (\p x, \p y).
+static inline void lensedCoordinate(const RippleParams &p, int x, int y, float *lx, float *ly) {
+  float nx = -1.0f + x * p.x_scale;
+  float ny = -1.0f + y * p.y_scale;
+  float dist = std::sqrt(nx * nx + ny * ny);
+  float g = dist > 0.0f ? sinSquared(dist * p.k) / dist : 0.0f;
+  *lx = g * nx;
+  *ly = g * ny;
+}
+
+/// @brief Check if \p step is a valid grid step of an interpolated ripple map, or throw a domain error.
+static void checkRippleMapStep(unsigned int step) {
+  if ((step == 0) || (step > RippleMap::max_step)) {
+    throw std::domain_error("Grid step must be from 1 to " + std::to_string(RippleMap::max_step) + ".");
+  }
+}
+
+std::shared_ptr<RippleMap> RippleMap::createInterpolated(unsigned int width, unsigned int height, float frequency,
+                                                         unsigned int step, RippleMapError *error,
+                                                         SimdLevel level) {
+  if ((size_t) width * height >= RippleMap::transparent) {
+    throw std::domain_error("Image too large for a ripple map.");
+  }
+  checkRippleMapStep(step);
+
+  auto map = std::make_shared<RippleMap>();
+  map->width = width;
+  map->height = height;
+  map->frequency = frequency;
+  map->step = step;
+  map->level = std::min(level, detectSimdLevel());
+  map->index.resize((size_t) width * height);
+
+  RippleParams params(width, height, frequency);
+  const int s = step;
+
+  // Grid points lie at every step pixels, plus one at the last row and column.
+  const int gw = (width - 1 + s - 1) / s + 1;
+  const int gh = (height - 1 + s - 1) / s + 1;
+  auto grid_x = [&](int i) { return std::min(i * s, (int) width - 1); };
+  auto grid_y = [&](int j) { return std::min(j * s, (int) height - 1); };
+
+  // Evaluate the lensed coordinates at the grid points
+  std::vector<float> glx((size_t) gw * gh);
+  std::vector<float> gly((size_t) gw * gh);
+  for (int j = 0; j < gh; j++) {
+    for (int i = 0; i < gw; i++) {
+      lensedCoordinate(params, grid_x(i), grid_y(j), &glx[j * gw + i], &gly[j * gw + i]);
+    }
+  }
+
+  size_t exact_pixels = 0;
+  if (error != nullptr) {
+    *error = RippleMapError();
+  }
+
+  // Cells with a transparent corner straddle the transparency boundary.
+  const int cw = std::max(gw - 1, 1);
+  const int ch = std::max(gh - 1, 1);
+  std::vector<char> boundary((size_t) cw * ch);
+  for (int j = 0; j < ch; j++) {
+    for (int i = 0; i < cw; i++) {
+      const int i1 = std::min(i + 1, gw - 1);
+      const int j1 = std::min(j + 1, gh - 1);
+      boundary[j * cw + i] = (lensedIndex(params, glx[j * gw + i], gly[j * gw + i]) == RippleMap::transparent)
+          || (lensedIndex(params, glx[j * gw + i1], gly[j * gw + i1]) == RippleMap::transparent)
+          || (lensedIndex(params, glx[j1 * gw + i], gly[j1 * gw + i]) == RippleMap::transparent)
+          || (lensedIndex(params, glx[j1 * gw + i1], gly[j1 * gw + i1]) == RippleMap::transparent);
+    }
+  }
+
+  // Interpolated lensed coordinates of one row
+  std::vector<float> row_x(width);
+  std::vector<float> row_y(width);
+
+  for (int j = 0; j < ch; j++) {
+    const int j1 = std::min(j + 1, gh - 1);
+    const int y0 = grid_y(j);
+    const int y1 = (j1 == gh - 1) ? (int) height : grid_y(j1);
+    const float inv_h = (grid_y(j1) > y0) ? 1.0f / (grid_y(j1) - y0) : 0.0f;
+
+    for (int y = y0; y < y1; y++) {
+      const float fy = (y - y0) * inv_h;
+
+      // Bilinearly interpolate the lensed coordinates of every cell on this row
+      for (int i = 0; i < cw; i++) {
+        const int i1 = std::min(i + 1, gw - 1);
+        const int x0 = grid_x(i);
+        const int x1 = (i1 == gw - 1) ? (int) width : grid_x(i1);
+        const float inv_w = (grid_x(i1) > x0) ? 1.0f / (grid_x(i1) - x0) : 0.0f;
+
+        const float left_x = glx[j * gw + i] + fy * (glx[j1 * gw + i] - glx[j * gw + i]);
+        const float left_y = gly[j * gw + i] + fy * (gly[j1 * gw + i] - gly[j * gw + i]);
+        const float step_x = (glx[j * gw + i1] + fy * (glx[j1 * gw + i1] - glx[j * gw + i1]) - left_x) * inv_w;
+        const float step_y = (gly[j * gw + i1] + fy * (gly[j1 * gw + i1] - gly[j * gw + i1]) - left_y) * inv_w;
+
+        for (int x = x0; x < x1; x++) {
+          row_x[x] = left_x + (x - x0) * step_x;
+          row_y[x] = left_y + (x - x0) * step_y;
+        }
+      }
+
+      // Convert the whole row to source indices
+      std::uint32_t *row = map->index.data() + (size_t) y * width;
+      lensedIndices(params, level, row_x.data(), row_y.data(), row, width);
+
+      // Evaluate the cells on the boundary exactly, and optionally compare the other cells to exact evaluation.
+      for (int i = 0; i < cw; i++) {
+        const int i1 = std::min(i + 1, gw - 1);
+        const int x0 = grid_x(i);
+        const int x1 = (i1 == gw - 1) ? (int) width : grid_x(i1);
+
+        if (boundary[j * cw + i]) {
+          rippleRect(params, level, nullptr, nullptr, map->index.data(), x0, x1, y, y + 1);
+          exact_pixels += x1 - x0;
+        } else if (error != nullptr) {
+          for (int x = x0; x < x1; x++) {
+            float ex, ey;
+            lensedCoordinate(params, x, y, &ex, &ey);
+            double dx = (double) (row_x[x] - ex) * params.half_width;
+            double dy = (double) (row_y[x] - ey) * params.half_height;
+            error->max_error = std::max(error->max_error, std::sqrt(dx * dx + dy * dy));
+            if (row[x] != lensedIndex(params, ex, ey)) {
+              error->mismatches++;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (error != nullptr) {
+    error->exact_pixels = exact_pixels;
+  }
+
+  return map;
+}
+
+std::shared_ptr<const RippleMap> getRippleMap(unsigned int width, unsigned int height, float frequency,
+                                              unsigned int step, SimdLevel level, ThreadPool *pool) {
+  checkRippleMapStep(step);
+  level = std::min(level, detectSimdLevel());
+  auto &cache = RippleMapCache::instance();
+
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    for (auto i = cache.maps.begin(); i != cache.maps.end(); i++) {
+      if (((*i)->width == width) && ((*i)->height == height) && sameFrequency((*i)->frequency, frequency)
+          && ((*i)->step == step) && ((*i)->level == level)) {
+        // Move the hit to the front, so the least recently used map is at the back.
+        cache.maps.splice(cache.maps.begin(), cache.maps, i);
+        return cache.maps.front();
+      }
+    }
+  }
+
+  // Compute the map outside the lock, so other geometries can be looked up in the mean time.
+  std::shared_ptr<const RippleMap> map = (step > 1)
+                                         ? RippleMap::createInterpolated(width, height, frequency, step, nullptr, level)
+                                         : RippleMap::create(width, height, frequency, level, pool);
+
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.maps.push_front(map);
+  if (cache.maps.size() > ripple_map_cache_capacity) {
+    cache.maps.pop_back();
+  }
+  return map;
+}
+
+void clearRippleMapCache() {
+  auto &cache = RippleMapCache::instance();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.maps.clear();
+}
+
+void applyRippleMap(const Image *src, Image *dest, const RippleMap *map) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr) && (map != nullptr));
+  if ((src->width != dest->width) || (src->height != dest->height)
+      || (src->width != map->width) || (src->height != map->height)) {
+    throw std::domain_error("Source image, destination image and ripple map are not of equal dimensions.");
+  }
+
+  const size_t n = (size_t) src->width * src->height;
+  const std::uint32_t *index = map->index.data();
+  const Pixel *in = src->pixels;
+  Pixel *out = dest->pixels;
+
+  // Gather every destination pixel from its source pixel
+  for (size_t i = 0; i < n; i++) {
+    if (index[i] == RippleMap::transparent) {
+      out[i] = Pixel{0, 0, 0, 0};
+    } else {
+      out[i] = in[index[i]];
+    }
+  }
+}
+
+void applyRippleFast(const Image *src, Image *dest, float frequency, SimdLevel level) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr));
+  if ((src->width != dest->width) || (src->height != dest->height)) {
+    throw std::domain_error("Source and destination image are not of equal dimensions.");
+  }
+
+  RippleParams params(src->width, src->height, frequency);
+  rippleRect(params, level, src->pixels, dest->pixels, nullptr, 0, src->width, 0, src->height);
+}
+
+void applyRippleMapTiled(const Image *src, Image *dest, const RippleMap *map, unsigned int tile_size,
+                         ThreadPool *pool) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr) && (map != nullptr) && (pool != nullptr));
+  if ((src->width != dest->width) || (src->height != dest->height)
+      || (src->width != map->width) || (src->height != map->height)) {
+    throw std::domain_error("Source image, destination image and ripple map are not of equal dimensions.");
+  }
+  if (tile_size == 0) {
+    throw std::domain_error("Tile size must be positive.");
+  }
+
+  const int width = src->width;
+  const std::uint32_t *index = map->index.data();
+  const Pixel *in = src->pixels;
+  Pixel *out = dest->pixels;
+
+  // For every destination tile
+  pool->parallelFor2D(src->width, src->height, tile_size, tile_size, [&](int tx, int x1, int ty, int y1) {
+    for (int y = ty; y < y1; y++) {
+      const std::uint32_t *row = index + (size_t) y * width;
+      Pixel *out_row = out + (size_t) y * width;
+
+      // Prefetch the source pixels of a destination row some rows ahead within this tile. Neighboring destination
+      // pixels mostly have neighboring sources, so one prefetch per few pixels is enough to cover the cache lines.
+      if (y + ripple_prefetch_rows < y1) {
+        const std::uint32_t *ahead = row + (size_t) ripple_prefetch_rows * width;
+        for (int x = tx; x < x1; x += ripple_prefetch_stride) {
+          if (ahead[x] != RippleMap::transparent) {
+            __builtin_prefetch(in + ahead[x]);
+          }
+        }
+      }
+
+      for (int x = tx; x < x1; x++) {
+        out_row[x] = (row[x] == RippleMap::transparent) ? Pixel{0, 0, 0, 0} : in[row[x]];
+      }
+    }
+  });
+}
+
+/// @brief Return the source coordinate of destination coordinate \p x displaced by fixed-point offset \p d.
+static inline int compactSource(int x, int d, int size) {
+  // The offset is in units of half the image size times 2^-14, so this is floor(x + d * size / 2^15).
+  return x + ((d * size) >> 15);
+}
+
+std::shared_ptr<CompactRippleMap> CompactRippleMap::create(unsigned int width, unsigned int height, float frequency) {
+  if ((width > CompactRippleMap::max_size) || (height > CompactRippleMap::max_size)) {
+    throw std::domain_error("Image too large for a compact ripple map.");
+  }
+
+  auto map = std::make_shared<CompactRippleMap>();
+  map->width = width;
+  map->height = height;
+  map->frequency = frequency;
+  map->quadrant_width = width / 2 + 1;
+  map->quadrant_height = height / 2 + 1;
+  map->offsets.resize((size_t) map->quadrant_width * map->quadrant_height * 2);
+
+  RippleParams params(width, height, frequency);
+
+  // Compute the fixed-point offsets of the top-left quadrant
+  for (int y = 0; y < map->quadrant_height; y++) {
+    float ny = -1.0f + y * params.y_scale;
+    for (int x = 0; x < map->quadrant_width; x++) {
+      float nx = -1.0f + x * params.x_scale;
+      float dist = std::sqrt(nx * nx + ny * ny);
+      float g = dist > 0.0f ? sinSquared(dist * params.k) / dist : 0.0f;
+      // The lensed coordinate minus the destination coordinate lies in [-2, 2].
+      float dx = std::round((g * nx - nx) * 16384.0f);
+      float dy = std::round((g * ny - ny) * 16384.0f);
+      size_t o = ((size_t) y * map->quadrant_width + x) * 2;
+      map->offsets[o] = (std::int16_t) std::max(-32768.0f, std::min(dx, 32767.0f));
+      map->offsets[o + 1] = (std::int16_t) std::max(-32768.0f, std::min(dy, 32767.0f));
+    }
+  }
+
+  // Find the transparent spans of every row, where the source lies outside of the image.
+  map->row_spans.resize(height + 1);
+  for (unsigned int y = 0; y < height; y++) {
+    map->row_spans[y] = (std::uint32_t) map->spans.size();
+    bool in_span = false;
+    for (unsigned int x = 0; x < width; x++) {
+      int dx, dy;
+      map->offset(x, y, &dx, &dy);
+      int sx = compactSource(x, dx, width);
+      int sy = compactSource(y, dy, height);
+      bool transparent = (sx < 0) || (sx >= (int) width) || (sy < 0) || (sy >= (int) height);
+      if (transparent && !in_span) {
+        map->spans.push_back(Span{(std::uint32_t) x, (std::uint32_t) width});
+      } else if (!transparent && in_span) {
+        map->spans.back().end = (std::uint32_t) x;
+      }
+      in_span = transparent;
+    }
+  }
+  map->row_spans[height] = (std::uint32_t) map->spans.size();
+
+  return map;
+}
+
+size_t CompactRippleMap::bytes() const {
+  return offsets.size() * sizeof(std::int16_t) + spans.size() * sizeof(Span) + row_spans.size() * sizeof(std::uint32_t);
+}
+
+/// @brief Gather the opaque pixels [x0, x1) of row \p y through a compact ripple map.
+static inline void compactGather(const CompactRippleMap *map, const Pixel *in, Pixel *out, int x0, int x1, int y) {
+  const int width = map->width;
+  const int height = map->height;
+  const int qw = map->quadrant_width;
+
+  // Rows in the bottom half mirror the rows in the top half, with the vertical offset negated.
+  const bool mirror_y = y >= map->quadrant_height;
+  const std::int16_t *q = map->offsets.data() + (size_t) (mirror_y ? height - y : y) * qw * 2;
+  const int sign_y = mirror_y ? -1 : 1;
+
+  Pixel *out_row = out + (size_t) y * width;
+
+  // Left half of the row
+  for (int x = x0; x < std::min(x1, qw); x++) {
+    int sx = compactSource(x, q[2 * x], width);
+    int sy = compactSource(y, sign_y * q[2 * x + 1], height);
+    out_row[x] = in[(size_t) sy * width + sx];
+  }
+
+  // Right half of the row, mirroring the left half with the horizontal offset negated
+  for (int x = std::max(x0, qw); x < x1; x++) {
+    int xq = width - x;
+    int sx = compactSource(x, -q[2 * xq], width);
+    int sy = compactSource(y, sign_y * q[2 * xq + 1], height);
+    out_row[x] = in[(size_t) sy * width + sx];
+  }
+}
+
+/// @brief Apply a ripple effect to rows [\p y0, \p y1) of \p dest using a compact ripple map.
+static void compactRows(const Image *src, Image *dest, const CompactRippleMap *map, int y0, int y1) {
+  const int width = src->width;
+
+  for (int y = y0; y < y1; y++) {
+    Pixel *out_row = dest->pixels + (size_t) y * width;
+    int x = 0;
+    // Gather up to every transparent span, and clear the span itself.
+    for (auto s = map->row_spans[y]; s < map->row_spans[y + 1]; s++) {
+      const auto &span = map->spans[s];
+      compactGather(map, src->pixels, dest->pixels, x, span.begin, y);
+      std::memset(out_row + span.begin, 0, (span.end - span.begin) * sizeof(Pixel));
+      x = span.end;
+    }
+    compactGather(map, src->pixels, dest->pixels, x, width, y);
+  }
+}
+
+/// @brief Check the arguments of applyRippleCompact(), or throw a domain error.
+static void checkCompactArguments(const Image *src, const Image *dest, const CompactRippleMap *map) {
+  assert((src != nullptr) && (dest != nullptr) && (map != nullptr));
+  if ((src->width != dest->width) || (src->height != dest->height)
+      || (src->width != map->width) || (src->height != map->height)) {
+    throw std::domain_error("Source image, destination image and ripple map are not of equal dimensions.");
+  }
+}
+
+void applyRippleCompact(const Image *src, Image *dest, const CompactRippleMap *map) {
+  checkCompactArguments(src, dest, map);
+  compactRows(src, dest, map, 0, (int) src->height);
+}
+
+void applyRippleCompact(const Image *src, Image *dest, const CompactRippleMap *map, ThreadPool *pool) {
+  checkCompactArguments(src, dest, map);
+  assert(pool != nullptr);
+  pool->parallelFor(0, src->height, ripple_band_rows, [&](size_t y0, size_t y1) {
+    compactRows(src, dest, map, (int) y0, (int) y1);
+  });
+}
+
+std::shared_ptr<RipplePolarMap> RipplePolarMap::create(unsigned int width, unsigned int height) {
+  auto polar = std::make_shared<RipplePolarMap>();
+  polar->width = width;
+  polar->height = height;
+
+  const size_t n = (size_t) width * height;
+  polar->radius.resize(n);
+  polar->dir_x.resize(n);
+  polar->dir_y.resize(n);
+
+  RippleParams params(width, height, 0.0f);
+
+  for (unsigned int y = 0; y < height; y++) {
+    float ny = -1.0f + y * params.y_scale;
+    for (unsigned int x = 0; x < width; x++) {
+      float nx = -1.0f + x * params.x_scale;
+      float dist = std::sqrt(nx * nx + ny * ny);
+      size_t i = (size_t) y * width + x;
+      polar->radius[i] = dist;
+      // In the center, the direction is undefined. Any direction will do since the lensed distance is zero.
+      polar->dir_x[i] = dist > 0.0f ? nx / dist : 0.0f;
+      polar->dir_y[i] = dist > 0.0f ? ny / dist : 0.0f;
+    }
+  }
+
+  return polar;
+}
+
+void applyRipplePolar(const Image *src, Image *dest, const RipplePolarMap *polar, float frequency, SimdLevel level) {
+  // Check arguments
+  assert((src != nullptr) && (dest != nullptr) && (polar != nullptr));
+  if ((src->width != dest->width) || (src->height != dest->height)
+      || (src->width != polar->width) || (src->height != polar->height)) {
+    throw std::domain_error("Source image, destination image and polar map are not of equal dimensions.");
+  }
+
+  RippleParams params(src->width, src->height, frequency);
+  polarRange(params, level, polar, src->pixels, dest->pixels, 0, (size_t) src->width * src->height);
+}
+
+void renderRippleAnimation(const Image *src, const std::vector<float> &frequencies, const FrameSink &sink,
+                           ThreadPool *pool) {
+  assert((src != nullptr) && (pool != nullptr));
+
+  // The polar coordinates do not depend on the frequency, so they are computed only once for all frames.
+  auto polar = RipplePolarMap::create(src->width, src->height);
+
+  // Every task renders a whole frame, and hands it off right away.
+  pool->run(frequencies.size(), [&](size_t f) {
+    auto frame = std::make_shared<Image>(src->width, src->height, Image::Uninitialized());
+    applyRipplePolar(src, frame.get(), polar.get(), frequencies[f]);
+    sink(f, std::move(frame));
+  });
+}
@@ -0,0 +1,309 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "../utils/Image.hpp"
+#include "../utils/Simd.hpp"
+#include "../utils/ThreadPool.hpp"
+
+/// @brief Error statistics of an interpolated ripple map with respect to exact evaluation.
+struct RippleMapError {
+  /// @brief Maximum distance in pixels between an interpolated and an exactly evaluated source coordinate.
+  double max_error = 0.0;
+
+  /// @brief Number of pixels whose source index differs from exact evaluation.
+  size_t mismatches = 0;
+
+  /// @brief Number of pixels that were evaluated exactly because their cell straddles the transparency boundary.
+  size_t exact_pixels = 0;
+};
+
+/**
+ * @brief A precomputed ripple displacement map.
+ *
+ * Holds, for every destination pixel, the linear index of the source pixel that the ripple effect gathers from,
+ * or RippleMap::transparent if the destination pixel is transparent. Because the source coordinates only depend on
+ * the image geometry and the ripple frequency, a map can be reused for every image of the same size.
+ *
+ * Maps are computed with the same formula as applyRippleFast().
+ */
+struct RippleMap {
+  /// @brief Source index of destination pixels that should be made transparent.
+  static const std::uint32_t transparent = 0xFFFFFFFFu;
+
+  /// @brief Largest grid step of an interpolated map. Coarser grids do not resolve the displacement field.
+  static const unsigned int max_step = 1024;
+
+  /// @brief Width of the images this map applies to.
+  unsigned int width = 0;
+
+  /// @brief Height of the images this map applies to.
+  unsigned int height = 0;
+
+  /// @brief Ripple frequency this map was computed for.
+  float frequency = 0.0f;
+
+  /// @brief Grid step the source coordinates were evaluated at, or 1 if every pixel was evaluated.
+  unsigned int step = 1;
+
+  /// @brief SIMD level the source coordinates were evaluated with.
+  SimdLevel level = SimdLevel::Scalar;
+
+  /// @brief Source pixel index for every destination pixel.
+  std::vector<std::uint32_t> index;
+
+  /**
+   * @brief Compute a new ripple map for images of \p width x \p height and ripple \p frequency.
+   * @param width     The image width.
+   * @param height    The image height.
+   * @param frequency The ripple frequency.
+   * @param level     The SIMD level to evaluate the source coordinates with.
+   * @param pool      The thread pool that computes bands of rows.
+   * @return          The ripple map.
+   */
+  static std::shared_ptr<RippleMap> create(unsigned int width, unsigned int height, float frequency,
+                                           SimdLevel level = detectSimdLevel(),
+                                           ThreadPool *pool = &ThreadPool::instance());
+
+  /**
+   * @brief Compute a new ripple map by evaluating the source coordinates on a coarse grid only.
+   *
+   * The ripple displacement field is smooth, so the source coordinates are evaluated every \p step pixels and
+   * bilinearly interpolated in between. Grid cells with a transparent corner straddle the transparency boundary,
+   * where the field is not continuous; those are evaluated exactly.
+   *
+   * @param width     The image width.
+   * @param height    The image height.
+   * @param frequency The ripple frequency.
+   * @param step      The grid step. A domain error is thrown unless it is from 1 to max_step.
+   * @param error     If not null, the map is also compared to exact evaluation and the error is stored here.
+   * @param level     The SIMD level to convert coordinates and evaluate boundary cells with.
+   * @return          The ripple map.
+   */
+  static std::shared_ptr<RippleMap> createInterpolated(unsigned int width, unsigned int height, float frequency,
+                                                       unsigned int step, RippleMapError *error = nullptr,
+                                                       SimdLevel level = detectSimdLevel());
+};
+
+/**
+ * @brief Return a ripple map for images of \p width x \p height and ripple \p frequency.
+ *
+ * Maps are kept in a small process-wide cache keyed by geometry, frequency, grid step and SIMD level, so subsequent
+ * images or frames of the same size reuse the map instead of recomputing it. This function is thread-safe.
+ *
+ * @param width     The image width.
+ * @param height    The image height.
+ * @param frequency The ripple frequency.
+ * @param step      If larger than 1, the map is interpolated from a grid with this step. See createInterpolated().
+ *                  A domain error is thrown unless it is from 1 to RippleMap::max_step.
+ * @param level     The SIMD level to compute the map with.
+ * @param pool      The thread pool to compute the map with.
+ * @return          A shared pointer to the (possibly cached) ripple map.
+ */
+std::shared_ptr<const RippleMap> getRippleMap(unsigned int width, unsigned int height, float frequency,
+                                              unsigned int step = 1, SimdLevel level = detectSimdLevel(),
+                                              ThreadPool *pool = &ThreadPool::instance());
+
+/// @brief Drop all ripple maps from the process-wide cache.
+void clearRippleMapCache();
+
+/**
+ * @brief Apply a ripple effect to \p src using a precomputed ripple map.
+ *
+ * The result is stored in \p dest, and is identical to the result of applyRippleFast() with the map frequency.
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param map       The ripple map. Its dimensions must match those of the images.
+ */
+void applyRippleMap(const Image *src, Image *dest, const RippleMap *map);
+
+/**
+ * @brief Apply a ripple effect to \p src using a precomputed ripple map, traversing the destination in tiles.
+ *
+ * The sources of a row-major sweep over the destination are scattered radially over the source image, which thrashes
+ * the caches and TLB for large images. The sources of a small destination tile lie in a compact footprint, so this
+ * gathers tile by tile, and prefetches the sources of upcoming rows. The result is identical to applyRippleMap().
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param map       The ripple map. Its dimensions must match those of the images.
+ * @param tile_size The width and height of the destination tiles.
+ * @param pool      The thread pool that processes the tiles.
+ */
+void applyRippleMapTiled(const Image *src, Image *dest, const RippleMap *map, unsigned int tile_size = 64,
+                         ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Apply a ripple effect to \p src without evaluating any transcendental functions.
+ *
+ * This computes the same effect as applyRipple() in single precision. The cosine and sine of the angle are replaced
+ * by nx / dist and ny / dist, and the remaining sine is evaluated with a minimax polynomial. The result is stored in
+ * \p dest, and is approximately equal to the result of applyRipple().
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param frequency The ripple frequency.
+ * @param level     The SIMD level to use. Levels not supported by the CPU fall back to the best supported level.
+ */
+void applyRippleFast(const Image *src, Image *dest, float frequency, SimdLevel level = detectSimdLevel());
+
+/**
+ * @brief A compact, fixed-point ripple displacement map.
+ *
+ * Instead of a 32-bit source index per pixel, this stores the displacement of the source relative to the destination
+ * pixel as two 16-bit fixed-point offsets. The ripple is point symmetric around the image center: mirroring a
+ * destination pixel mirrors its displacement. Therefore only the top-left quadrant is stored, which makes the map
+ * about a quarter of the size of a RippleMap. Destination pixels whose source lies outside of the image are stored as
+ * per-row transparent spans, which are cleared with memset.
+ *
+ * Offsets are in units of 2^-14 times half the image size, so coordinates are exact up to one pixel for images of up
+ * to max_size pixels wide and high.
+ */
+struct CompactRippleMap {
+  /// @brief Maximum width and height of an image a compact map can be created for.
+  static const unsigned int max_size = 32768;
+
+  /// @brief A range [begin, end) of transparent pixels within a row.
+  struct Span {
+    std::uint32_t begin;
+    std::uint32_t end;
+  };
+
+  /// @brief Width of the images this map applies to.
+  unsigned int width = 0;
+
+  /// @brief Height of the images this map applies to.
+  unsigned int height = 0;
+
+  /// @brief Ripple frequency this map was computed for.
+  float frequency = 0.0f;
+
+  /// @brief Width of the stored quadrant.
+  int quadrant_width = 0;
+
+  /// @brief Height of the stored quadrant.
+  int quadrant_height = 0;
+
+  /// @brief Interleaved horizontal and vertical fixed-point offsets of the pixels in the top-left quadrant.
+  std::vector<std::int16_t> offsets;
+
+  /// @brief Transparent spans of all rows.
+  std::vector<Span> spans;
+
+  /// @brief Index of the first span of every row in spans, plus the total number of spans.
+  std::vector<std::uint32_t> row_spans;
+
+  /// @brief Obtain the fixed-point offsets of destination pixel (\p x, \p y).
+  inline void offset(int x, int y, int *dx, int *dy) const {
+    bool mirror_x = x >= quadrant_width;
+    bool mirror_y = y >= quadrant_height;
+    size_t o = ((size_t) (mirror_y ? height - y : y) * quadrant_width + (mirror_x ? width - x : x)) * 2;
+    *dx = mirror_x ? -offsets[o] : offsets[o];
+    *dy = mirror_y ? -offsets[o + 1] : offsets[o + 1];
+  }
+
+  /// @brief Return the size of this map in bytes.
+  size_t bytes() const;
+
+  /// @brief Compute a new compact ripple map for images of \p width x \p height and ripple \p frequency.
+  static std::shared_ptr<CompactRippleMap> create(unsigned int width, unsigned int height, float frequency);
+};
+
+/**
+ * @brief Apply a ripple effect to \p src using a compact ripple map.
+ *
+ * The result is stored in \p dest, and is approximately equal to the result of applyRipple().
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param map       The compact ripple map. Its dimensions must match those of the images.
+ */
+void applyRippleCompact(const Image *src, Image *dest, const CompactRippleMap *map);
+
+/**
+ * @brief Apply a ripple effect to \p src using a compact ripple map, processing bands of rows concurrently.
+ *
+ * The result is identical to that of applyRippleCompact() without a thread pool.
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param map       The compact ripple map. Its dimensions must match those of the images.
+ * @param pool      The thread pool that processes the bands.
+ */
+void applyRippleCompact(const Image *src, Image *dest, const CompactRippleMap *map, ThreadPool *pool);
+
+/**
+ * @brief Frequency-independent polar coordinates of every pixel, for rendering ripple animations.
+ *
+ * Of the ripple formula, only src_dist = sin^2(dist * pi / 2 * frequency) depends on the frequency. This map holds
+ * the normalized distance to the center and the unit direction of every pixel, such that each frame of a frequency
+ * sweep only costs one sine evaluation and one gather per pixel.
+ */
+struct RipplePolarMap {
+  /// @brief Width of the images this map applies to.
+  unsigned int width = 0;
+
+  /// @brief Height of the images this map applies to.
+  unsigned int height = 0;
+
+  /// @brief Normalized distance of every pixel to the center of the image.
+  std::vector<float> radius;
+
+  /// @brief Horizontal component of the unit direction of every pixel from the center. Zero in the center.
+  std::vector<float> dir_x;
+
+  /// @brief Vertical component of the unit direction of every pixel from the center. Zero in the center.
+  std::vector<float> dir_y;
+
+  /// @brief Compute a new polar map for images of \p width x \p height.
+  static std::shared_ptr<RipplePolarMap> create(unsigned int width, unsigned int height);
+};
+
+/**
+ * @brief Apply a ripple effect to \p src using precomputed polar coordinates.
+ *
+ * The result is stored in \p dest, and is approximately equal to the result of applyRipple().
+ *
+ * @param src       The source image.
+ * @param dest      The destination image.
+ * @param polar     The polar map. Its dimensions must match those of the images.
+ * @param frequency The ripple frequency.
+ * @param level     The SIMD level to use.
+ */
+void applyRipplePolar(const Image *src, Image *dest, const RipplePolarMap *polar, float frequency,
+                      SimdLevel level = detectSimdLevel());
+
+/// @brief Function receiving the index and the image of every rendered frame of an animation.
+using FrameSink = std::function<void(size_t, std::shared_ptr<Image>)>;
+
+/**
+ * @brief Render a ripple animation of \p src, with one frame for every frequency in \p frequencies.
+ *
+ * Frames are rendered concurrently, one task per frame. Every frame is handed to \p sink as soon as it is rendered,
+ * in any order, and is not kept by this function. The sink may block to bound the number of frames in flight.
+ *
+ * @param src         The source image.
+ * @param frequencies The ripple frequency of every frame.
+ * @param sink        The function receiving every frame, with its index in \p frequencies.
+ * @param pool        The thread pool to render with.
+ */
+void renderRippleAnimation(const Image *src, const std::vector<float> &frequencies, const FrameSink &sink,
+                           ThreadPool *pool = &ThreadPool::instance());
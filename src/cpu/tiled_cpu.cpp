@@ -0,0 +1,91 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <memory>
+#include <stdexcept>
+
+#include "../baseline/imgproc.hpp"
+
+#include "tiled_cpu.hpp"
+
+Histogram getHistogramTiled(const TiledImage *src, ThreadPool *pool) {
+  const unsigned int tiles_x = src->tilesX();
+  const size_t tiles = (size_t) tiles_x * src->tilesY();
+
+  // Count every tile into its own histogram, and sum them up.
+  Histogram hist;
+  const size_t size = hist.values.size();
+  hist.values = pool->parallelReduce(
+      0, tiles, 1, std::vector<Histogram::Count>(size, 0),
+      [&](size_t t0, size_t t1) {
+        std::vector<Histogram::Count> counts(size, 0);
+        for (size_t t = t0; t < t1; t++) {
+          Region r = src->tile((unsigned int) (t % tiles_x), (unsigned int) (t / tiles_x));
+          Image tile(r.width, r.height, Image::Uninitialized());
+          src->readRegion(r, &tile);
+          auto tile_hist = getHistogram(&tile);
+          for (size_t i = 0; i < size; i++) {
+            counts[i] += tile_hist.values[i];
+          }
+        }
+        return counts;
+      },
+      [&](std::vector<Histogram::Count> a, const std::vector<Histogram::Count> &b) {
+        for (size_t i = 0; i < size; i++) {
+          a[i] += b[i];
+        }
+        return a;
+      });
+
+  return hist;
+}
+
+void runWaterEffectTiled(const TiledImage *src, TiledImage *dest, const WaterEffectOptions *options,
+                         ThreadPool *pool) {
+  if ((dest == src) || (dest->width != src->width) || (dest->height != src->height)) {
+    throw std::domain_error("Destination image must be another image of the same dimensions as the source.");
+  }
+  if (options->enhance && !options->histogram) {
+    throw std::runtime_error("Cannot run enhance stage without histogram.");
+  }
+
+  // Tiles are too small and too many to report their stages.
+  WaterEffectOptions tile_options = *options;
+  tile_options.save_intermediate = false;
+  tile_options.report_stages = false;
+
+  // The histogram is global, so it is obtained before any tile is processed.
+  std::shared_ptr<Histogram> hist;
+  if (options->histogram) {
+    hist = std::make_shared<Histogram>(getHistogramTiled(src, pool));
+  }
+
+  // Destination tiles are written by exactly one task each.
+  const unsigned int tiles_x = dest->tilesX();
+  pool->parallelFor(0, (size_t) tiles_x * dest->tilesY(), 1, [&](size_t t0, size_t t1) {
+    for (size_t t = t0; t < t1; t++) {
+      Region roi = dest->tile((unsigned int) (t % tiles_x), (unsigned int) (t / tiles_x));
+      RippleSources sources;
+      Region input = getWaterEffectInputRegion(roi, src->width, src->height, &tile_options, &sources);
+      Image window(input.width, input.height, Image::Uninitialized());
+      src->readRegion(input, &window);
+
+      // Without any image stage, the result is the input, which is then the tile itself.
+      auto result = runWaterEffect(&window, input, src->width, src->height, &tile_options, roi, hist.get(),
+                                   options->ripple ? &sources : nullptr);
+      dest->writeRegion(roi, result == nullptr ? &window : result.get());
+    }
+  });
+}
@@ -0,0 +1,49 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "../baseline/water.hpp"
+#include "../utils/Histogram.hpp"
+#include "../utils/ThreadPool.hpp"
+#include "../utils/TiledImage.hpp"
+
+/**
+ * @brief Obtain the histogram of a tiled image, reading and counting its tiles concurrently.
+ *
+ * Counts are 64-bit, so the histogram of images of more than 2^31 pixels does not overflow.
+ *
+ * @param src       The source image.
+ * @param pool      The thread pool that processes the tiles.
+ * @return          The histogram.
+ */
+Histogram getHistogramTiled(const TiledImage *src, ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Apply a water effect to a tiled image, tile by tile, for images that do not fit in memory.
+ *
+ * The histogram is obtained in a first pass over all tiles. Then every tile of the result is computed on its own: the
+ * region of the source it depends on is inferred with getWaterEffectInputRegion(), read from \p src, and passed
+ * through the region pipeline of runWaterEffect(). Tiles are processed concurrently, so the memory in use is bounded by
+ * a few tiles and their input regions per thread, regardless of the size of the image. The result is identical to
+ * that of runWaterEffect() on the whole image. Intermediate images are not saved.
+ *
+ * @param src       The source image.
+ * @param dest      The destination image, which must be writable and of the size of the source image.
+ * @param options   The options for the water effect.
+ * @param pool      The thread pool that processes the tiles.
+ */
+void runWaterEffectTiled(const TiledImage *src, TiledImage *dest, const WaterEffectOptions *options,
+                         ThreadPool *pool = &ThreadPool::instance());
@@ -0,0 +1,222 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <stdexcept>
+
+#include "../utils/Histogram.hpp"
+#include "../utils/ImagePool.hpp"
+#include "../utils/ImageWriter.hpp"
+#include "../utils/StageGraph.hpp"
+
+#include "imgproc_cpu.hpp"
+#include "ripple_cpu.hpp"
+#include "water_cpu.hpp"
+
+/**
+ * @brief An intermediate image of the pipeline, with the number of stages that still have to read it.
+ *
+ * The image is released as soon as its last reader completes, which returns its buffer to the image pool for the next
+ * stage to reuse. This way a frame needs no more than two full-size intermediate buffers at a time.
+ */
+struct IntermediateImage {
+  /// @brief The image.
+  std::shared_ptr<Image> image;
+
+  /// @brief Number of stages that did not read the image yet.
+  std::atomic<int> readers{0};
+
+  /// @brief Whether this image is the result of the pipeline, which is not released.
+  bool result = false;
+
+  /// @brief Signal that a reader is done.
+  void release() {
+    if ((--readers == 0) && !result) {
+      image.reset();
+    }
+  }
+};
+
+std::shared_ptr<Image> runWaterEffectCPU(const Image *src, const WaterEffectOptions *options, SimdLevel level,
+                                         ThreadPool *pool, Image *dest) {
+  if (options->enhance && !options->histogram) {
+    throw std::runtime_error("Cannot run enhance stage without histogram.");
+  }
+  if ((dest != nullptr) && ((dest == src) || (dest->width != src->width) || (dest->height != src->height))) {
+    throw std::domain_error("Destination image must be another image of the same dimensions as the source.");
+  }
+
+  StageGraph graph;
+  ImagePool &images = ImagePool::instance();
+  ImageWriter &writer = ImageWriter::instance();
+
+  // Intermediate results. Every one of them is produced by a single stage, and only read by its dependents.
+  std::shared_ptr<Histogram> hist;
+  IntermediateImage img_enhanced;
+  IntermediateImage img_rippled;
+  IntermediateImage img_blurred;
+  std::shared_ptr<const RippleMap> map;
+  std::shared_ptr<const CompactRippleMap> compact_map;
+
+  // The latest image of the pipeline, and the stage producing it, if any.
+  IntermediateImage *img_result = nullptr;
+  std::vector<size_t> result_stage;
+
+  // Register a reader of an intermediate image, or of the source image if it is null.
+  auto read = [](IntermediateImage *img) {
+    if (img != nullptr) {
+      img->readers++;
+    }
+    return img;
+  };
+  auto input = [src](IntermediateImage *img) { return img == nullptr ? src : img->image.get(); };
+  auto done = [](IntermediateImage *img) {
+    if (img != nullptr) {
+      img->release();
+    }
+  };
+  // Obtain the buffer of a stage. The result goes into the destination, if any.
+  auto allocate = [&](IntermediateImage *img) {
+    if (img->result && (dest != nullptr)) {
+      img->image = std::shared_ptr<Image>(dest, [](Image *) {});
+    } else {
+      img->image = images.acquire(src->width, src->height);
+    }
+  };
+
+  // Intermediate images are saved by the background writer, which holds a reference until they are written.
+  auto save = [&](const std::shared_ptr<Image> &img, const std::string &suffix) {
+    writer.write(img, options->outputFile(suffix));
+  };
+
+  // Histogram stage
+  size_t histogram_stage = 0;
+  if (options->histogram) {
+    histogram_stage = graph.add("Histogram", [&]() {
+      hist = std::make_shared<Histogram>(getHistogramCPU(src, pool));
+      if (options->save_intermediate) {
+        save(hist->toImage(), "_histogram");
+      }
+    });
+  }
+
+  // Contrast enhancement stage
+  if (options->enhance) {
+    const size_t enhance_stage = graph.add("Contrast enhance", [&]() {
+      // Determine the threshold from the histogram, by taking 10% of the maximum value in the histogram.
+      auto threshold = (Histogram::Count) (hist->max(0) * 0.1);
+
+      // Enhance the contrast on the color channels and copy over the alpha channel
+      allocate(&img_enhanced);
+      enhanceContrastLinearlyCPU(src, hist.get(), img_enhanced.image.get(), threshold, threshold, pool);
+      if (options->save_intermediate) {
+        save(img_enhanced.image, "_enhanced");
+      }
+    }, {histogram_stage});
+
+    // Create and save the enhanced histogram (if enabled).
+    if (options->enhance_hist) {
+      auto in = read(&img_enhanced);
+      graph.add("Enhanced histogram", [&, in]() {
+        auto enhanced_hist = getHistogramCPU(in->image.get(), pool);
+        done(in);
+        save(enhanced_hist.toImage(), "_enhanced_histogram");
+      }, {enhance_stage}, false);
+    }
+
+    img_result = &img_enhanced;
+    result_stage = {enhance_stage};
+  }
+
+  if (options->ripple) {
+    // Compact maps only encode offsets for images up to a maximum size. Larger images use a full map instead.
+    const bool compact = options->ripple_map_compact && (src->width <= CompactRippleMap::max_size)
+        && (src->height <= CompactRippleMap::max_size);
+
+    // The ripple map only depends on the image geometry, so it is obtained concurrently with the previous stages.
+    const size_t map_stage = graph.add("Ripple map", [&, compact]() {
+      if (compact) {
+        compact_map = CompactRippleMap::create(src->width, src->height, options->ripple_frequency);
+      } else {
+        map = getRippleMap(src->width, src->height, options->ripple_frequency, options->ripple_map_step, level, pool);
+      }
+    });
+    auto dependencies = result_stage;
+    dependencies.push_back(map_stage);
+    auto in = read(img_result);
+
+    // Only full maps are fused with the blur, since that gathers through source indices.
+    if (options->blur && !options->save_intermediate && !compact) {
+      // Fused ripple effect and Gaussian blur stage. The rippled image is never materialized.
+      const size_t blur_stage = graph.add("Ripple + blur", [&, in]() {
+        auto gaussian = getGaussianKernel(options->blur_size);
+        allocate(&img_blurred);
+        convoluteTiled(input(in), img_blurred.image.get(), gaussian.get(), map.get(), 64, pool);
+        done(in);
+      }, dependencies);
+
+      img_result = &img_blurred;
+      result_stage = {blur_stage};
+    } else {
+      // Ripple effect stage, which is just a gather through the map.
+      const size_t ripple_stage = graph.add("Ripple effect", [&, in]() {
+        allocate(&img_rippled);
+        if (compact_map != nullptr) {
+          applyRippleCompact(input(in), img_rippled.image.get(), compact_map.get(), pool);
+        } else {
+          applyRippleMapTiled(input(in), img_rippled.image.get(), map.get(), 64, pool);
+        }
+        done(in);
+        if (options->save_intermediate) {
+          save(img_rippled.image, "_rippled");
+        }
+      }, dependencies);
+
+      img_result = &img_rippled;
+      result_stage = {ripple_stage};
+    }
+  }
+
+  // Gaussian blur stage, unless it was fused with the ripple effect
+  if (options->blur && (img_result != &img_blurred)) {
+    auto in = read(img_result);
+    graph.add("Blur", [&, in]() {
+      // Copy the input into an image with a zero halo, so the kernel reads past the edges without bounds checks.
+      auto gaussian = getGaussianKernel(options->blur_size);
+      const Image *img = input(in);
+      auto padded = images.acquirePadded(img->width, img->height, options->blur_size / 2);
+      padded->copyFrom(img, Border::Zero, pool);
+      done(in);
+      allocate(&img_blurred);
+      convolutePadded(padded.get(), img_blurred.image.get(), gaussian.get(), 64, pool);
+      if (options->save_intermediate) {
+        save(img_blurred.image, "_blurred");
+      }
+    }, result_stage);
+
+    img_result = &img_blurred;
+  }
+
+  // The result is kept alive for the caller.
+  if (img_result != nullptr) {
+    img_result->result = true;
+  }
+
+  graph.execute(pool);
+  if (options->report_stages) {
+    graph.report();
+  }
+
+  return (img_result == nullptr) ? nullptr : img_result->image;
+}
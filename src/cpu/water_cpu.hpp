@@ -0,0 +1,37 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "../utils/Image.hpp"
+#include "../utils/Simd.hpp"
+#include "../utils/ThreadPool.hpp"
+
+#include "../baseline/water.hpp"
+
+/**
+ * @brief Return an image on which a water effect was applied, using the optimized CPU implementation.
+ *
+ * @param src       The source image .
+ * @param options   The options for the water effect.
+ * @param level     The SIMD level of the ripple kernels.
+ * @param pool      The thread pool that executes the stages.
+ * @param dest      If not null, the last stage writes its result directly into this image instead of a new one. It
+ *                  must have the dimensions of \p src, and must not be \p src.
+ * @return          A smart pointer to a new image, or one that refers to \p dest without owning it.
+ */
+std::shared_ptr<Image> runWaterEffectCPU(const Image *src, const WaterEffectOptions *options,
+                                         SimdLevel level = detectSimdLevel(),
+                                         ThreadPool *pool = &ThreadPool::instance(),
+                                         Image *dest = nullptr);
@@ -13,28 +13,99 @@
 // limitations under the License.
 
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <getopt.h>
+#include <sys/stat.h>
+#include <climits>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
 
 #include "utils/Image.hpp"
 #include "utils/Kernel.hpp"
 #include "utils/Timer.hpp"
-
+#include "utils/PerfCounters.hpp"
+#include "utils/ThreadPool.hpp"
+#include "utils/ImagePool.hpp"
+#include "utils/ImageWriter.hpp"
+#include "utils/SharedImage.hpp"
+#include "utils/TiledImage.hpp"
+
+#include "baseline/imgproc.hpp"
 #include "baseline/water.hpp"
+#include "cpu/ripple_cpu.hpp"
+#include "cpu/tiled_cpu.hpp"
+#include "qoi/qoi.hpp"
+#include "backends.hpp"
+#include "batch.hpp"
+#include "stream.hpp"
+#include "server.hpp"
+
+/// @brief Parse \p arg as an integer from \p min to \p max into \p value. Return false if it is not such an integer.
+static bool parseInteger(const char *arg, long min, long max, long *value) {
+  char *end;
+  errno = 0;
+  long v = std::strtol(arg, &end, 10);
+  if ((end == arg) || (*end != '\0') || (errno != 0) || (v < min) || (v > max)) {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+/// @brief Parse \p arg as a finite number into \p value. Return false if it is not such a number.
+static bool parseFloat(const char *arg, float *value) {
+  char *end;
+  errno = 0;
+  float v = std::strtof(arg, &end);
+  // This program is built with -ffinite-math-only, which assumes that std::isfinite() holds, so check the exponent.
+  std::uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  if ((end == arg) || (*end != '\0') || (errno != 0) || ((bits & 0x7F800000u) == 0x7F800000u)) {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+/// @brief Largest number of threads of any kind that the options accept.
+static const long max_threads = 1024;
 
-#ifdef USE_CUDA
-#include "students/water_cuda.hpp"
-#endif
+/// @brief Largest width or height of stream frames that the options accept.
+static const long max_frame_size = 16384;
+
+/// @brief Largest number of frames of a ripple animation that the options accept.
+static const long max_sweep_frames = 100000;
 
 /// @brief Structure to pass program options
 struct ProgramOptions {
   std::string input_file = "";
-  bool cuda = false;
+  std::vector<std::string> backends;
   bool test = false;
+  int sweep_frames = 0;
+  bool traversals = false;
+  unsigned int threads = 0;
+  bool batch = false;
+  BatchOptions batch_opts;
+  bool stream = false;
+  StreamOptions stream_opts;
+  std::string serve_socket;
+  std::string connect_socket;
+  bool shared = false;
+  bool codecs = false;
+  std::string quit_socket;
+  bool use_roi = false;
+  Region roi;
+  bool tiled = false;
   WaterEffectOptions water_opts;
 
   /// @brief Print usage information
   static void usage(char *argv[]) {
-    std::cerr << "Usage: " << argv[0] << " -hanmeifc -g G -r R <image.png>\n"
+    std::cerr << "Usage: " << argv[0] << " -hanmeifptcd -g G -r R -s N -l L -j J -b B <image.png | directory | list>\n"
               << "Options:\n"
                  "  -h    Show help.\n"
                  "\n"
@@ -44,68 +115,558 @@ struct ProgramOptions {
                  "  -e    Contrast enhancement (enables histogram).\n"
                  "  -n    Output contrast enhanced histogram as image (unaffected by -i).\n"
                  "  -r R  Ripple effect with frequency R.\n"
+                 "  -s N  Render an N frame ripple animation, sweeping the frequency up to R.\n"
+                 "  -t    Compare ripple gather traversals, reporting cache and TLB misses.\n"
+                 "  -l L  Interpolate CPU ripple maps from a grid of every L-th pixel.\n"
+                 "  --compact-map\n"
+                 "        Gather the CPU ripple stage through compact fixed-point ripple maps.\n"
+                 "  -j J  Use J threads for the CPU implementation (default: number of hardware threads).\n"
                  "\n"
                  "  -i    Save intermediate images.\n"
                  "  -f    Run full baseline pipeline.\n"
                  "\n"
-                 "  -c    Run full pipeline using CUDA.\n"
-                 "  -a    Run full baseline & CUDA pipeline, compare output.\n";
+                 "  -p    Run full pipeline using the optimized CPU implementation (same as --backend cpu-mt).\n"
+                 "  -c    Run full pipeline using CUDA (same as --backend cuda).\n"
+                 "  -b B, --backend B\n"
+                 "        Run full pipeline using backend B. Use \"auto\" to select it from the image size,\n"
+                 "        or \"list\" to show all backends.\n"
+                 "  -a    Run full baseline and all backends, compare output.\n"
+                 "\n"
+                 "  -d, --batch\n"
+                 "        Process a batch of images: all PNG files in a directory, or the images listed one per line\n"
+                 "        in a file. Uses the first backend selected with -b or -p, or \"auto\" by default.\n"
+                 "  --decoders N, --workers N, --encoders N\n"
+                 "        Number of threads decoding, processing and encoding batch images (default: 1).\n"
+                 "  --stream WxH\n"
+                 "        Read raw RGBA frames of WxH pixels from stdin, and write the results to stdout. No image\n"
+                 "        argument is required. --workers sets the number of threads processing frames.\n"
+                 "\n"
+                 "  --serve S\n"
+                 "        Serve jobs on the Unix domain socket S, keeping pools, kernels and ripple maps warm.\n"
+                 "  --connect S\n"
+                 "        Send the selected pipeline for the image to the server on socket S, instead of running it.\n"
+                 "  --shm Hand the image to the server through shared memory, instead of as a file.\n"
+                 "\n"
+                 "  --format F\n"
+                 "        Write images as F: png (default), pam for page-aligned raw RGBA files that can be\n"
+                 "        memory-mapped, or qoi for fast lossless compression. Input files are read by extension.\n"
+                 "  --codecs\n"
+                 "        Compare the PNG and QOI codecs on the image, or on all images in a directory.\n"
+                 "  --quit S\n"
+                 "        Stop the server on socket S.\n"
+                 "  --roi X,Y,W,H\n"
+                 "        Also run the baseline pipeline for the region of W x H pixels at (X, Y) only, and compare\n"
+                 "        it to that region of the full result.\n"
+                 "  --tiled\n"
+                 "        Also store the image as a tiled image file, run the pipeline on it tile by tile, and\n"
+                 "        compare it to the full result. Tiled image files (.tiles) are always processed tile by\n"
+                 "        tile without loading them, and the result is written as a tiled image file. PAM files are\n"
+                 "        converted to a tiled image file without loading them, and are then processed likewise.\n"
+                 "        With --format pam, the tiled result is also written as a PAM file.\n"
+                 "  --output-dir D\n"
+                 "        Write all output images to directory D (default: output), which is created if needed.\n";
 
     std::cerr.flush();
     exit(0);
   }
 
+  /// @brief Compare the fast ripple kernel at every supported SIMD level to the baseline ripple effect.
+  void testRippleKernels(const Image *img) {
+    Image img_baseline(img->width, img->height);
+    applyRipple(img, &img_baseline, water_opts.ripple_frequency);
+
+    for (int l = 0; l <= (int) detectSimdLevel(); l++) {
+      auto level = (SimdLevel) l;
+      Image img_fast(img->width, img->height);
+      applyRippleFast(img, &img_fast, water_opts.ripple_frequency, level);
+      std::cout << "Ripple kernel (" << toString(level) << "):" << std::endl;
+      if (img_fast.is_approximately_equal_to(&img_baseline)) {
+        std::cout << "Test passed." << std::endl;
+      } else {
+        std::cout << "Test failed." << std::endl;
+      }
+    }
+
+    auto compact_map = CompactRippleMap::create(img->width, img->height, water_opts.ripple_frequency);
+    Image img_compact(img->width, img->height);
+    applyRippleCompact(img, &img_compact, compact_map.get());
+    std::cout << "Ripple kernel (compact map):" << std::endl;
+    if (img_compact.is_approximately_equal_to(&img_baseline)) {
+      std::cout << "Test passed." << std::endl;
+    } else {
+      std::cout << "Test failed." << std::endl;
+    }
+
+    if (water_opts.ripple_map_step > 1) {
+      RippleMapError error;
+      auto interpolated_map = RippleMap::createInterpolated(img->width, img->height, water_opts.ripple_frequency,
+                                                            water_opts.ripple_map_step, &error);
+      Image img_interpolated(img->width, img->height);
+      applyRippleMap(img, &img_interpolated, interpolated_map.get());
+      std::cout << "Ripple kernel (interpolated map, step " << water_opts.ripple_map_step << "):" << std::endl
+                << "Maximum coordinate error: " << error.max_error << " pixels, "
+                << error.mismatches << " mismatching and " << error.exact_pixels << " exactly evaluated pixels."
+                << std::endl;
+      if (img_interpolated.is_approximately_equal_to(&img_baseline)) {
+        std::cout << "Test passed." << std::endl;
+      } else {
+        std::cout << "Test failed." << std::endl;
+      }
+    }
+  }
+
+  /// @brief Measure the row-major and tiled ripple gathers, including hardware cache and TLB counters.
+  void benchmarkRippleTraversals(const Image *img) {
+    Timer t;
+    PerfCounters pc;
+
+    t.start();
+    auto map = RippleMap::create(img->width, img->height, water_opts.ripple_frequency);
+    t.stop();
+    std::cout << "Ripple map (exact):        " << t.seconds() << " s." << std::endl;
+
+    if (water_opts.ripple_map_step > 1) {
+      RippleMapError error;
+      t.start();
+      RippleMap::createInterpolated(img->width, img->height, water_opts.ripple_frequency, water_opts.ripple_map_step);
+      t.stop();
+      RippleMap::createInterpolated(img->width, img->height, water_opts.ripple_frequency, water_opts.ripple_map_step,
+                                    &error);
+      std::cout << "Ripple map (step " << water_opts.ripple_map_step << "):        " << t.seconds() << " s, "
+                << "maximum coordinate error: " << error.max_error << " pixels." << std::endl;
+    }
+
+    Image img_rippled(img->width, img->height);
+
+    t.start();
+    pc.start();
+    applyRippleMap(img, &img_rippled, map.get());
+    pc.stop();
+    t.stop();
+    std::cout << "Ripple gather (row-major): " << t.seconds() << " s." << std::endl << "  ";
+    pc.report();
+
+    for (unsigned int tile_size : {16, 32, 64, 128}) {
+      t.start();
+      pc.start();
+      applyRippleMapTiled(img, &img_rippled, map.get(), tile_size);
+      pc.stop();
+      t.stop();
+      std::cout << "Ripple gather (tiled " << tile_size << "x" << tile_size << "): " << t.seconds() << " s."
+                << std::endl << "  ";
+      pc.report();
+    }
+
+    auto compact_map = CompactRippleMap::create(img->width, img->height, water_opts.ripple_frequency);
+    t.start();
+    pc.start();
+    applyRippleCompact(img, &img_rippled, compact_map.get());
+    pc.stop();
+    t.stop();
+    std::cout << "Ripple gather (compact map): " << t.seconds() << " s." << std::endl << "  ";
+    pc.report();
+
+    std::cout << "Ripple map size: " << map->index.size() * sizeof(std::uint32_t) << " bytes, compact: "
+              << compact_map->bytes() << " bytes." << std::endl;
+  }
+
+  /// @brief Compare encode and decode throughput, and compressed size, of lodepng and QOI on every image in \p files.
+  static void benchmarkCodecs(const std::vector<std::string> &files) {
+    Timer t;
+    std::cout << std::left << std::setw(24) << "Image" << std::setw(8) << "Codec" << std::right << std::setw(12)
+              << "Bytes" << std::setw(10) << "Ratio" << std::setw(14) << "Encode MB/s" << std::setw(14)
+              << "Decode MB/s" << std::endl;
+
+    for (const auto &file : files) {
+      auto img = Image::fromFile(file);
+      const double megabytes = img->bytes() * 1e-6;
+      auto name = file.substr(file.find_last_of("\\/") + 1);
+      auto row = [&](const std::string &codec, size_t bytes, double encode_seconds, double decode_seconds) {
+        std::cout << std::left << std::setw(24) << name << std::setw(8) << codec << std::right << std::setw(12)
+                  << bytes << std::setw(10) << std::setprecision(3) << (double) img->bytes() / bytes
+                  << std::setw(14) << std::setprecision(4) << megabytes / encode_seconds << std::setw(14)
+                  << megabytes / decode_seconds << std::endl;
+      };
+
+      unsigned char *png = nullptr;
+      size_t png_size = 0;
+      t.start();
+      lodepng_encode32(&png, &png_size, img->data(), img->width, img->height);
+      t.stop();
+      double encode_seconds = t.seconds();
+      unsigned char *decoded = nullptr;
+      unsigned int width, height;
+      t.start();
+      lodepng_decode32(&decoded, &width, &height, png, png_size);
+      t.stop();
+      free(decoded);
+      free(png);
+      row("png", png_size, encode_seconds, t.seconds());
+
+      std::vector<unsigned char> qoi;
+      t.start();
+      qoiEncode(img->data(), img->width, img->height, &qoi);
+      t.stop();
+      encode_seconds = t.seconds();
+      Image img_qoi(img->width, img->height, Image::Uninitialized());
+      t.start();
+      qoiDecode(qoi.data(), qoi.size(), img_qoi.data());
+      t.stop();
+      row("qoi", qoi.size(), encode_seconds, t.seconds());
+      if (std::memcmp(img_qoi.data(), img->data(), img->bytes()) != 0) {
+        std::cout << "QOI round trip of " << name << " failed." << std::endl;
+      }
+    }
+  }
+
+  /// @brief Print the resident set size before a pipeline ran, and the peak while it ran.
+  static void reportMemory(size_t rss_before) {
+    std::cout << "Memory: " << rss_before / (1024.0 * 1024.0) << " MiB resident before, "
+              << getPeakRSS() / (1024.0 * 1024.0) << " MiB peak." << std::endl;
+  }
+
+  /// @brief Print the names and descriptions of all registered backends.
+  static void listBackends() {
+    for (const auto &b : getBackends()) {
+      std::cout << std::left << std::setw(12) << b.name << b.description << std::endl;
+    }
+    std::cout << std::left << std::setw(12) << "auto" << "Select the best backend from the image size." << std::endl;
+  }
+
+  /**
+   * @brief Wait for the background image writer, and report its encode time if it wrote anything.
+   *
+   * Images are written outside of the timed pipelines. Draining before the next measurement keeps the encoder from
+   * competing with it for the cores.
+   */
+  static void reportWriter() {
+    ImageWriter &writer = ImageWriter::instance();
+    writer.drain();
+    if (writer.stats().images > 0) {
+      writer.report();
+    }
+    writer.resetStats();
+  }
+
+  /// @brief Run the whole pipeline using the backend \p name, and compare it to the baseline if testing is enabled.
+  void runBackend(const std::string &name, const Image *img, const Image *img_baseline_result) {
+    const Backend *backend = (name == "auto") ? selectBackend(img->width, img->height) : findBackend(name);
+    if (backend == nullptr) {
+      if (name == "cuda") {
+        std::cout << "Project was built without CUDA support.\n"
+                     "Skipping CUDA pipeline and test." << std::endl;
+      } else {
+        std::cerr << "Unknown backend " << name << ". Use --backend list to show all backends." << std::endl;
+      }
+      return;
+    }
+
+    Timer tt;
+    ThreadPool::instance().resetStats();
+    ImagePool::instance().resetStats();
+    size_t rss_before = getCurrentRSS();
+    resetPeakRSS();
+    tt.start();
+    auto img_result = backend->run(img, &water_opts);
+    tt.stop();
+    std::cout << std::left << std::setw(26) << ("Full pipeline (" + backend->name + "): ") << std::right
+              << tt.seconds() << " s." << std::endl;
+    reportMemory(rss_before);
+    if (ThreadPool::instance().stats().tasks > 0) {
+      ThreadPool::instance().report();
+    }
+    if (ImagePool::instance().stats().allocations + ImagePool::instance().stats().reuses > 0) {
+      ImagePool::instance().report();
+    }
+
+    if (img_result == nullptr) {
+      std::cerr << "Backend " << backend->name << " returned nullptr. Cannot output PNG." << std::endl;
+      return;
+    }
+
+    ImageWriter::instance().write(img_result, water_opts.outputFile("_result_" + backend->name));
+    reportWriter();
+
+    // Compare the backend to the baseline if testing is enabled
+    if (test && (img_baseline_result != nullptr)) {
+      if (img_result->is_approximately_equal_to(img_baseline_result)) {
+        std::cout << "Test passed (" << backend->name << ")." << std::endl;
+      } else {
+        std::cout << "Test failed (" << backend->name << ")." << std::endl;
+      }
+    }
+  }
+
+  /// @brief Process all images of the batch \p path.
+  void runBatchMode(const std::string &path) {
+    const Backend *backend = nullptr;
+    if (!backends.empty() && (backends[0] != "auto")) {
+      backend = findBackend(backends[0]);
+      if (backend == nullptr) {
+        std::cerr << "Unknown backend " << backends[0] << ". Use --backend list to show all backends." << std::endl;
+        return;
+      }
+    }
+    auto files = getBatchInputs(path);
+    auto stats = runBatch(files, backend, &water_opts, batch_opts);
+    ImageWriter::instance().drain();
+    stats.report();
+  }
+
+  /// @brief Process raw frames from stdin to stdout. Everything but the frames is printed on stderr.
+  void runStreamMode() {
+    const Backend *backend = nullptr;
+    if (!backends.empty() && (backends[0] != "auto")) {
+      backend = findBackend(backends[0]);
+      if (backend == nullptr) {
+        std::cerr << "Unknown backend " << backends[0] << ". Use --backend list to show all backends." << std::endl;
+        return;
+      }
+    } else {
+      backend = selectBackend(stream_opts.width, stream_opts.height);
+    }
+    stream_opts.workers = batch_opts.workers;
+    try {
+      auto stats = runStream(stdin, stdout, backend, &water_opts, stream_opts);
+      ImageWriter::instance().drain();
+      stats.report(std::cerr);
+    } catch (const std::exception &e) {
+      ImageWriter::instance().drain();
+      std::cerr << "Stream: " << e.what() << std::endl;
+    }
+  }
+
+  /// @brief Send the selected pipeline for the input image to a server, and print its reply.
+  void runClient() {
+    ServerJob job;
+    if (!backends.empty()) {
+      job.backend = backends[0];
+    }
+    job.options = water_opts;
+
+    char path[PATH_MAX];
+    std::string output = water_opts.outputFile("_result");
+    if (!shared) {
+      // The server may run in another working directory, so send absolute paths.
+      job.input = (realpath(input_file.c_str(), path) != nullptr) ? std::string(path) : input_file;
+      if (getcwd(path, sizeof(path)) != nullptr) {
+        job.output = std::string(path) + "/" + output;
+      }
+      std::cout << sendServerRequest(connect_socket, job.toString()) << std::endl;
+      return;
+    }
+
+    // Place the image in a shared segment, and let the server write the result into a second one.
+    auto img = Image::fromFile(input_file);
+    job.input_shm = "/imgproc-" + std::to_string(getpid()) + "-in";
+    job.output_shm = "/imgproc-" + std::to_string(getpid()) + "-out";
+    auto shared_in = createSharedImage(job.input_shm, img->width, img->height);
+    auto shared_out = createSharedImage(job.output_shm, img->width, img->height);
+    std::memcpy(shared_in->data(), img->data(), img->bytes());
+
+    auto reply = sendServerRequest(connect_socket, job.toString());
+    std::cout << reply << std::endl;
+    removeSharedImage(job.input_shm);
+    removeSharedImage(job.output_shm);
+    if (reply.compare(0, 2, "ok") == 0) {
+      shared_out->toFile(output);
+    }
+  }
+
+  /// @brief Run the baseline pipeline for the region of interest only, and compare it to the full result.
+  void runRegion(const Image *img, const Image *img_baseline_result) {
+    if (roi.empty() || !roi.within(img->width, img->height)) {
+      std::cerr << "Region of interest does not lie within the image." << std::endl;
+      return;
+    }
+    Timer tt;
+    tt.start();
+    auto img_roi = runWaterEffect(img, &water_opts, roi);
+    tt.stop();
+    std::cout << "Region pipeline (baseline): " << tt.seconds() << " s for " << roi.width << "x" << roi.height
+              << " pixels at (" << roi.x << ", " << roi.y << ")." << std::endl;
+    if ((img_roi == nullptr) || (img_baseline_result == nullptr)) {
+      return;
+    }
+    ImageWriter::instance().write(img_roi, water_opts.outputFile("_roi"));
+    reportWriter();
+
+    Image expected(roi.width, roi.height, Image::Uninitialized());
+    copyView(ConstImageView(img_baseline_result).sub(roi), &expected);
+    if (std::memcmp(expected.data(), img_roi->data(), expected.bytes()) == 0) {
+      std::cout << "Test passed (region)." << std::endl;
+    } else {
+      std::cout << "Test failed (region)." << std::endl;
+    }
+  }
+
+  /// @brief Run the pipeline tile by tile on the tiled image file \p file, and return the tiled result.
+  std::shared_ptr<TiledImage> runTiledFile(const std::string &file) {
+    auto src = TiledImage::open(file);
+    auto dest = TiledImage::create(water_opts.output_dir + "/" + water_opts.img_name + "_result.tiles", src->width,
+                                   src->height, src->tile_size);
+    size_t rss_before = getCurrentRSS();
+    resetPeakRSS();
+    Timer tt;
+    tt.start();
+    runWaterEffectTiled(src.get(), dest.get(), &water_opts);
+    tt.stop();
+    std::cout << "Tiled pipeline:           " << tt.seconds() << " s for " << src->width << "x" << src->height
+              << " pixels in " << (size_t) src->tilesX() * src->tilesY() << " tiles." << std::endl;
+    reportMemory(rss_before);
+    return dest;
+  }
+
+  /**
+   * @brief Run the pipeline tile by tile on the tiled image or PAM file \p file, without loading the whole image.
+   *
+   * A PAM file is first converted to a tiled image file. If the output format is PAM, the tiled result is also written
+   * as a PAM file.
+   */
+  void runTiledStreaming(const std::string &file) {
+    std::string tiles_file = file;
+    if (Image::isPAM(file)) {
+      tiles_file = water_opts.output_dir + "/" + water_opts.img_name + ".tiles";
+      Timer tt;
+      tt.start();
+      TiledImage::fromPAM(file, tiles_file);
+      tt.stop();
+      std::cout << "Tiled import:             " << tt.seconds() << " s." << std::endl;
+    }
+    auto dest = runTiledFile(tiles_file);
+    if (Image::isPAM(water_opts.image_extension)) {
+      Timer tt;
+      tt.start();
+      dest->toPAM(water_opts.outputFile("_result"));
+      tt.stop();
+      std::cout << "Tiled export:             " << tt.seconds() << " s." << std::endl;
+    }
+  }
+
+  /// @brief Store the image as a tiled image file, run the pipeline tile by tile, and compare it to the full result.
+  void runTiled(const Image *img, const Image *img_baseline_result) {
+    const std::string file = water_opts.output_dir + "/" + water_opts.img_name + ".tiles";
+    TiledImage::fromImage(img, file);
+    auto dest = runTiledFile(file);
+    if (img_baseline_result == nullptr) {
+      return;
+    }
+    auto result = dest->toImage();
+    if (std::memcmp(img_baseline_result->data(), result->data(), result->bytes()) == 0) {
+      std::cout << "Test passed (tiled)." << std::endl;
+    } else {
+      std::cout << "Test failed (tiled)." << std::endl;
+    }
+  }
+
   /// @brief Run everything selected through the options.
   void run() {
-    // Load the image.
-    auto img = Image::fromPNG(input_file);
-    std::shared_ptr<Image> img_baseline_result;
+    if (codecs) {
+      struct stat info;
+      bool directory = (stat(input_file.c_str(), &info) == 0) && S_ISDIR(info.st_mode);
+      benchmarkCodecs(directory ? getBatchInputs(input_file) : std::vector<std::string>{input_file});
+      return;
+    }
+    if (!serve_socket.empty()) {
+      runServer(serve_socket, water_opts.output_dir);
+      return;
+    }
+    if (!quit_socket.empty()) {
+      std::cout << sendServerRequest(quit_socket, "quit") << std::endl;
+      return;
+    }
+    if (!connect_socket.empty()) {
+      runClient();
+      return;
+    }
+    if (stream) {
+      runStreamMode();
+      return;
+    }
+    if (batch) {
+      runBatchMode(input_file);
+      return;
+    }
 
+    // Tiled image files, and PAM files that are to be tiled, may not fit in memory, so they are only processed tile by
+    // tile.
+    if (TiledImage::isTiled(input_file) || (tiled && Image::isPAM(input_file))) {
+      runTiledStreaming(input_file);
+      return;
+    }
+
+    // Load the image.
     Timer tt;
+    tt.start();
+    auto img = Image::fromFile(input_file);
+    tt.stop();
+    std::cout << "Load image:               " << tt.seconds() << " s." << std::endl;
+    std::shared_ptr<Image> img_baseline_result;
 
     // Start the total pipeline measurement.
+    size_t rss_before = getCurrentRSS();
+    resetPeakRSS();
     tt.start();
     img_baseline_result = runWaterEffect(img.get(), &water_opts);
     // Stop the timer for the baseline pipeline.
     tt.stop();
     std::cout << "Full pipeline (baseline): " << tt.seconds() << " s." << std::endl;
+    reportMemory(rss_before);
 
 
     // Save the final result if any image was produced
     if (img_baseline_result != nullptr) {
-      img_baseline_result->toPNG("output/" + water_opts.img_name + "_result.png");
+      ImageWriter::instance().write(img_baseline_result, water_opts.outputFile("_result"));
+    }
+    reportWriter();
+
+    // Run the pipeline for the region of interest only
+    if (use_roi) {
+      runRegion(img.get(), img_baseline_result.get());
+    }
+
+    // Run the pipeline tile by tile on a tiled copy of the image
+    if (tiled) {
+      runTiled(img.get(), img_baseline_result.get());
+    }
+
+    // Compare ripple traversal orders
+    if (traversals) {
+      benchmarkRippleTraversals(img.get());
     }
 
-    // Run the whole pipeline using CUDA
-    if (cuda) {
-#ifdef USE_CUDA
+    // Render a ripple animation
+    if (sweep_frames > 0) {
+      std::vector<float> frequencies;
+      for (int f = 0; f < sweep_frames; f++) {
+        frequencies.push_back(water_opts.ripple_frequency * (f + 1) / sweep_frames);
+      }
+
+      // Frames are queued for writing as they are rendered. Rendering waits for the writer when it falls behind, so
+      // only a few frames per thread are in memory at a time.
+      ImageWriter &writer = ImageWriter::instance();
+      const size_t max_pending = 2 * ThreadPool::instance().size();
       tt.start();
-      auto img_cuda_result = runWaterEffectCUDA(img.get(), &water_opts);
+      renderRippleAnimation(img.get(), frequencies, [&](size_t f, std::shared_ptr<Image> frame) {
+        std::stringstream suffix;
+        suffix << "_ripple_" << std::setw(4) << std::setfill('0') << f;
+        writer.wait(max_pending);
+        writer.write(std::move(frame), water_opts.outputFile(suffix.str()));
+      });
       tt.stop();
-      std::cout << "Full pipeline (CUDA):     " << tt.seconds() << " s." << std::endl;
+      std::cout << "Ripple animation:         " << tt.seconds() << " s, "
+                << sweep_frames / tt.seconds() << " frames/s, including writing." << std::endl;
+      ThreadPool::instance().report();
+      reportWriter();
+    }
 
-      if (img_cuda_result != nullptr) {
-        img_cuda_result->toPNG("output/" + water_opts.img_name + "_result.png");
-      } else {
-        std::cerr << "CUDA water effect returned nullptr. Cannot output PNG." << std::endl;
-      }
+    // Run the whole pipeline using every selected backend
+    if (test && !backends.empty()) {
+      testRippleKernels(img.get());
+    }
 
-      // Compare the CUDA implementation to the baseline if testing is enabled
-      if (test) {
-        if (img_cuda_result != nullptr) {
-          if (img_cuda_result->is_approximately_equal_to(img_baseline_result.get())) {
-            std::cout << "Test passed." << std::endl;
-          } else {
-            std::cout << "Test failed." << std::endl;
-          }
-        } else {
-          std::cerr << "CUDA water effect returned nullptr. Cannot test approximate equality." << std::endl;
-        }
-      }
-#else
-      std::cout << "Project was built without CUDA support.\n"
-                   "Skipping CUDA pipeline and test." << std::endl;
-#endif
+    for (const auto &name : backends) {
+      runBackend(name, img.get(), img_baseline_result.get());
     }
   }
 };
@@ -119,8 +680,28 @@ int main(int argc, char *argv[]) {
   }
 
   // Use GNU getopt to parse command line options
+  static const struct option long_options[] = {
+      {"help", no_argument, nullptr, 'h'},
+      {"backend", required_argument, nullptr, 'b'},
+      {"batch", no_argument, nullptr, 'd'},
+      {"decoders", required_argument, nullptr, 'D'},
+      {"workers", required_argument, nullptr, 'W'},
+      {"encoders", required_argument, nullptr, 'E'},
+      {"stream", required_argument, nullptr, 'S'},
+      {"serve", required_argument, nullptr, 'V'},
+      {"connect", required_argument, nullptr, 'C'},
+      {"quit", required_argument, nullptr, 'Q'},
+      {"shm", no_argument, nullptr, 'M'},
+      {"format", required_argument, nullptr, 'F'},
+      {"codecs", no_argument, nullptr, 'K'},
+      {"roi", required_argument, nullptr, 'R'},
+      {"tiled", no_argument, nullptr, 'T'},
+      {"compact-map", no_argument, nullptr, 'P'},
+      {"output-dir", required_argument, nullptr, 'O'},
+      {nullptr, 0, nullptr, 0}
+  };
   int opt;
-  while ((opt = getopt(argc, argv, "hg:menfir:ac")) != -1) {
+  while ((opt = getopt_long(argc, argv, "hg:menfir:s:tl:j:apcb:d", long_options, nullptr)) != -1) {
     switch (opt) {
 
       case 'h': {
@@ -128,8 +709,22 @@ int main(int argc, char *argv[]) {
         break;
       }
 
+      case 'p': {
+        po.backends.push_back("cpu-mt");
+        break;
+      }
+
       case 'c': {
-        po.cuda = true;
+        po.backends.push_back("cuda");
+        break;
+      }
+
+      case 'b': {
+        if (std::string(optarg) == "list") {
+          ProgramOptions::listBackends();
+          exit(0);
+        }
+        po.backends.push_back(optarg);
         break;
       }
 
@@ -164,25 +759,161 @@ int main(int argc, char *argv[]) {
         break;
 
       case 'r': {
-        char *end;
-        po.water_opts.ripple_frequency = (unsigned int) std::strtof(optarg, &end);
+        if (!parseFloat(optarg, &po.water_opts.ripple_frequency)) {
+          std::cerr << "Option -r requires a finite frequency." << std::endl;
+          ProgramOptions::usage(argv);
+        }
         po.water_opts.ripple = true;
         break;
       }
 
+      case 's': {
+        long frames;
+        if (!parseInteger(optarg, 1, max_sweep_frames, &frames)) {
+          std::cerr << "Option -s requires a number of frames from 1 to " << max_sweep_frames << "." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.sweep_frames = (int) frames;
+        break;
+      }
+
+      case 't':po.traversals = true;
+        break;
+
+      case 'l': {
+        long step;
+        if (!parseInteger(optarg, 1, RippleMap::max_step, &step)) {
+          std::cerr << "Option -l requires a grid step from 1 to " << RippleMap::max_step << "." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.water_opts.ripple_map_step = (unsigned int) step;
+        break;
+      }
+
+      case 'j': {
+        long n;
+        if (!parseInteger(optarg, 1, max_threads, &n)) {
+          std::cerr << "Option -j requires a number of threads from 1 to " << max_threads << "." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.threads = (unsigned int) n;
+        break;
+      }
+
+      case 'd':po.batch = true;
+        break;
+
+      case 'D': {
+        long n;
+        if (!parseInteger(optarg, 1, max_threads, &n)) {
+          std::cerr << "Option --decoders requires a number of threads from 1 to " << max_threads << "." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.batch_opts.decoders = (unsigned int) n;
+        break;
+      }
+
+      case 'W': {
+        long n;
+        if (!parseInteger(optarg, 1, max_threads, &n)) {
+          std::cerr << "Option --workers requires a number of threads from 1 to " << max_threads << "." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.batch_opts.workers = (unsigned int) n;
+        break;
+      }
+
+      case 'E': {
+        long n;
+        if (!parseInteger(optarg, 1, max_threads, &n)) {
+          std::cerr << "Option --encoders requires a number of threads from 1 to " << max_threads << "." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.batch_opts.encoders = (unsigned int) n;
+        break;
+      }
+
+      case 'S': {
+        const std::string size = optarg;
+        const auto x = size.find_first_of("xX");
+        long width, height;
+        if ((x == std::string::npos) || !parseInteger(size.substr(0, x).c_str(), 1, max_frame_size, &width)
+            || !parseInteger(size.substr(x + 1).c_str(), 1, max_frame_size, &height)) {
+          std::cerr << "Option --stream requires a frame size WxH, with W and H from 1 to " << max_frame_size << "."
+                    << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.stream_opts.width = (unsigned int) width;
+        po.stream_opts.height = (unsigned int) height;
+        po.stream = true;
+        break;
+      }
+
+      case 'V':po.serve_socket = optarg;
+        break;
+
+      case 'C':po.connect_socket = optarg;
+        break;
+
+      case 'Q':po.quit_socket = optarg;
+        break;
+
+      case 'M':po.shared = true;
+        break;
+
+      case 'K':po.codecs = true;
+        break;
+
+      case 'R': {
+        unsigned int x, y, width, height;
+        if (std::sscanf(optarg, "%u,%u,%u,%u", &x, &y, &width, &height) != 4) {
+          std::cerr << "Option --roi requires a region X,Y,W,H." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.roi = Region(x, y, width, height);
+        po.use_roi = true;
+        break;
+      }
+
+      case 'T':po.tiled = true;
+        break;
+
+      case 'P':po.water_opts.ripple_map_compact = true;
+        break;
+
+      case 'O':po.water_opts.output_dir = optarg;
+        break;
+
+      case 'F': {
+        std::string format = optarg;
+        if ((format != "png") && (format != "pam") && (format != "qoi")) {
+          std::cerr << "Unknown image format " << format << "." << std::endl;
+          ProgramOptions::usage(argv);
+        }
+        po.water_opts.image_extension = "." + format;
+        break;
+      }
+
       case 'a': {
         po.water_opts.blur = true;
         po.water_opts.histogram = true;
         po.water_opts.enhance = true;
         po.water_opts.ripple = true;
         po.test = true;
-        po.cuda = true;
+        for (const auto &b : getBackends()) {
+          if (b.name != "baseline") {
+            po.backends.push_back(b.name);
+          }
+        }
         break;
       }
 
       case '?':
-        if ((optopt == 'g') || (optopt == 'r')) {
-          std::cerr << "Options -g and -r require an argument." << std::endl;
+        if ((optopt == 'g') || (optopt == 'r') || (optopt == 's') || (optopt == 'l') || (optopt == 'j')
+            || (optopt == 'b') || (optopt == 'D') || (optopt == 'W') || (optopt == 'E') || (optopt == 'S')
+            || (optopt == 'V') || (optopt == 'C') || (optopt == 'Q') || (optopt == 'F') || (optopt == 'R')) {
+          std::cerr << "Options -g, -r, -s, -l, -j, -b, --decoders, --workers, --encoders, --stream, --serve, "
+                       "--connect, --quit, --format and --roi require an argument." << std::endl;
           ProgramOptions::usage(argv);
         }
         break;
@@ -192,8 +923,12 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // Check if last argument is a filename.
-  if (argv[argc - 1][0] != '-') {
+  // Check if last argument is a filename. Streams and the server have no file.
+  if (po.stream) {
+    po.water_opts.img_name = "stream";
+  } else if (!po.serve_socket.empty() || !po.quit_socket.empty()) {
+    // Jobs carry their own image names.
+  } else if (argv[argc - 1][0] != '-') {
     // File name is last argument.
     po.input_file = std::string(argv[argc - 1]);
     // Strip any path
@@ -205,11 +940,13 @@ int main(int argc, char *argv[]) {
   }
 
   // Create an output directory, if it doesn't already exist.
-  // This only works for cool operating systems.
-  if (system("mkdir -p output") != 0) {
+  if ((mkdir(po.water_opts.output_dir.c_str(), 0755) != 0) && (errno != EEXIST)) {
     throw std::runtime_error("Could not create output directory.");
   }
 
+  // Size the thread pool shared by all stages of the CPU implementation
+  ThreadPool::configure(po.threads);
+
   // Run everything
   po.run();
 
@@ -0,0 +1,208 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstdint>
+#include <cstring>
+
+#include "qoi.hpp"
+
+// Operation tags. The 2-bit tags are in the upper bits of the byte, the 8-bit tags take the whole byte.
+static const unsigned char qoi_op_index = 0x00;
+static const unsigned char qoi_op_diff = 0x40;
+static const unsigned char qoi_op_luma = 0x80;
+static const unsigned char qoi_op_run = 0xc0;
+static const unsigned char qoi_op_rgb = 0xfe;
+static const unsigned char qoi_op_rgba = 0xff;
+static const unsigned char qoi_mask_2 = 0xc0;
+
+/// @brief The stream ends with seven zero bytes and a one.
+static const unsigned char qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+/// @brief An RGBA pixel that is compared as a whole.
+union QoiPixel {
+  struct {
+    unsigned char r, g, b, a;
+  } rgba;
+  std::uint32_t v;
+};
+
+/// @brief Return the position of a pixel in the index of recently seen pixels.
+static inline unsigned int qoiHash(const QoiPixel &p) {
+  return (p.rgba.r * 3 + p.rgba.g * 5 + p.rgba.b * 7 + p.rgba.a * 11) % 64;
+}
+
+static inline void qoiWrite32(unsigned char *p, std::uint32_t v) {
+  p[0] = (unsigned char) (v >> 24);
+  p[1] = (unsigned char) (v >> 16);
+  p[2] = (unsigned char) (v >> 8);
+  p[3] = (unsigned char) v;
+}
+
+static inline std::uint32_t qoiRead32(const unsigned char *p) {
+  return ((std::uint32_t) p[0] << 24) | ((std::uint32_t) p[1] << 16) | ((std::uint32_t) p[2] << 8) | p[3];
+}
+
+bool qoiEncode(const unsigned char *rgba, unsigned int width, unsigned int height, std::vector<unsigned char> *out) {
+  const size_t pixels = (size_t) width * height;
+  if ((pixels == 0) || (pixels > qoi_max_pixels)) {
+    return false;
+  }
+
+  // Every pixel takes at most 5 bytes, so write without bounds checks and shrink afterwards.
+  out->resize(qoi_header_size + pixels * 5 + sizeof(qoi_padding));
+  unsigned char *bytes = out->data();
+  std::memcpy(bytes, "qoif", 4);
+  qoiWrite32(bytes + 4, width);
+  qoiWrite32(bytes + 8, height);
+  bytes[12] = 4;  // channels
+  bytes[13] = 0;  // sRGB with linear alpha
+  size_t p = qoi_header_size;
+
+  QoiPixel index[64];
+  std::memset(index, 0, sizeof(index));
+  QoiPixel prev;
+  prev.v = 0;
+  prev.rgba.a = 255;
+  int run = 0;
+
+  for (size_t i = 0; i < pixels; i++) {
+    QoiPixel px;
+    std::memcpy(&px, rgba + i * 4, 4);
+
+    if (px.v == prev.v) {
+      run++;
+      if ((run == 62) || (i == pixels - 1)) {
+        bytes[p++] = (unsigned char) (qoi_op_run | (run - 1));
+        run = 0;
+      }
+      continue;
+    }
+
+    if (run > 0) {
+      bytes[p++] = (unsigned char) (qoi_op_run | (run - 1));
+      run = 0;
+    }
+
+    const unsigned int h = qoiHash(px);
+    if (index[h].v == px.v) {
+      bytes[p++] = (unsigned char) (qoi_op_index | h);
+    } else {
+      index[h] = px;
+      if (px.rgba.a == prev.rgba.a) {
+        const signed char vr = (signed char) (px.rgba.r - prev.rgba.r);
+        const signed char vg = (signed char) (px.rgba.g - prev.rgba.g);
+        const signed char vb = (signed char) (px.rgba.b - prev.rgba.b);
+        const signed char vg_r = (signed char) (vr - vg);
+        const signed char vg_b = (signed char) (vb - vg);
+
+        if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+          bytes[p++] = (unsigned char) (qoi_op_diff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+        } else if ((vg_r > -9) && (vg_r < 8) && (vg > -33) && (vg < 32) && (vg_b > -9) && (vg_b < 8)) {
+          bytes[p++] = (unsigned char) (qoi_op_luma | (vg + 32));
+          bytes[p++] = (unsigned char) ((vg_r + 8) << 4 | (vg_b + 8));
+        } else {
+          bytes[p++] = qoi_op_rgb;
+          bytes[p++] = px.rgba.r;
+          bytes[p++] = px.rgba.g;
+          bytes[p++] = px.rgba.b;
+        }
+      } else {
+        bytes[p++] = qoi_op_rgba;
+        std::memcpy(bytes + p, &px, 4);
+        p += 4;
+      }
+    }
+    prev = px;
+  }
+
+  std::memcpy(bytes + p, qoi_padding, sizeof(qoi_padding));
+  p += sizeof(qoi_padding);
+  out->resize(p);
+  return true;
+}
+
+bool qoiReadHeader(const unsigned char *data, size_t size, unsigned int *width, unsigned int *height) {
+  if ((size < qoi_header_size + sizeof(qoi_padding)) || (std::memcmp(data, "qoif", 4) != 0)) {
+    return false;
+  }
+  *width = qoiRead32(data + 4);
+  *height = qoiRead32(data + 8);
+  const unsigned char channels = data[12];
+  const unsigned char colorspace = data[13];
+  return (*width != 0) && (*height != 0) && ((size_t) *width * *height <= qoi_max_pixels)
+         && ((channels == 3) || (channels == 4)) && (colorspace <= 1);
+}
+
+bool qoiDecode(const unsigned char *data, size_t size, unsigned char *rgba) {
+  unsigned int width;
+  unsigned int height;
+  if (!qoiReadHeader(data, size, &width, &height)) {
+    return false;
+  }
+  const size_t pixels = (size_t) width * height;
+  const size_t chunks_end = size - sizeof(qoi_padding);
+  if (std::memcmp(data + chunks_end, qoi_padding, sizeof(qoi_padding)) != 0) {
+    return false;
+  }
+  size_t p = qoi_header_size;
+
+  QoiPixel index[64];
+  std::memset(index, 0, sizeof(index));
+  QoiPixel px;
+  px.v = 0;
+  px.rgba.a = 255;
+  int run = 0;
+
+  for (size_t i = 0; i < pixels; i++) {
+    if (run > 0) {
+      run--;
+    } else if (p < chunks_end) {
+      const unsigned char b1 = data[p++];
+      if (b1 == qoi_op_rgb) {
+        px.rgba.r = data[p];
+        px.rgba.g = data[p + 1];
+        px.rgba.b = data[p + 2];
+        p += 3;
+      } else if (b1 == qoi_op_rgba) {
+        std::memcpy(&px, data + p, 4);
+        p += 4;
+      } else if ((b1 & qoi_mask_2) == qoi_op_index) {
+        px = index[b1];
+      } else if ((b1 & qoi_mask_2) == qoi_op_diff) {
+        px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+        px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+        px.rgba.b += (b1 & 0x03) - 2;
+      } else if ((b1 & qoi_mask_2) == qoi_op_luma) {
+        const unsigned char b2 = data[p++];
+        const int vg = (b1 & 0x3f) - 32;
+        px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+        px.rgba.g += vg;
+        px.rgba.b += vg - 8 + (b2 & 0x0f);
+      } else {
+        run = b1 & 0x3f;
+      }
+      index[qoiHash(px)] = px;
+      // A chunk must not extend into the padding.
+      if (p > chunks_end) {
+        return false;
+      }
+    } else {
+      // Truncated data.
+      return false;
+    }
+    std::memcpy(rgba + i * 4, &px, 4);
+  }
+  return true;
+}
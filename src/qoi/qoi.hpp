@@ -0,0 +1,59 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief An encoder and decoder for the Quite OK Image format (QOI), see https://qoiformat.org/.
+ *
+ * QOI compresses losslessly with a single pass of byte-sized operations per pixel, without entropy coding. It
+ * compresses less than PNG, but encodes and decodes an order of magnitude faster, which suits intermediate images
+ * and hand-offs between programs. Only 4-channel images are written; both 3- and 4-channel images are read.
+ */
+
+/// @brief Size of the QOI header in bytes.
+static const size_t qoi_header_size = 14;
+
+/// @brief Maximum number of pixels of a QOI image, as defined by the specification.
+static const size_t qoi_max_pixels = 400000000;
+
+/**
+ * @brief Encode \p width x \p height RGBA pixels as QOI image.
+ * @param rgba    The pixels, 4 bytes each, in row-major order.
+ * @param width   The image width.
+ * @param height  The image height.
+ * @param out     The buffer that the encoded image replaces the contents of.
+ * @return        False if the image is empty or too large to encode.
+ */
+bool qoiEncode(const unsigned char *rgba, unsigned int width, unsigned int height, std::vector<unsigned char> *out);
+
+/**
+ * @brief Read the dimensions of the QOI image in \p data of \p size bytes.
+ * @return False if \p data does not start with a valid QOI header.
+ */
+bool qoiReadHeader(const unsigned char *data, size_t size, unsigned int *width, unsigned int *height);
+
+/**
+ * @brief Decode the QOI image in \p data of \p size bytes into RGBA pixels.
+ * @param data    The encoded image, including its header.
+ * @param size    The size of \p data in bytes.
+ * @param rgba    The destination of width x height pixels of 4 bytes, with the dimensions from qoiReadHeader().
+ * @return        False if the header is invalid, or if the data is truncated or does not end with the QOI padding. The
+ *                contents of \p rgba are then undefined.
+ */
+bool qoiDecode(const unsigned char *data, size_t size, unsigned char *rgba);
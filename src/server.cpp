@@ -0,0 +1,359 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils/Image.hpp"
+#include "utils/ImageWriter.hpp"
+#include "utils/SharedImage.hpp"
+#include "utils/Timer.hpp"
+#include "cpu/ripple_cpu.hpp"
+#include "backends.hpp"
+
+#include "server.hpp"
+
+/// @brief Largest blur kernel size a job may request.
+static const long max_job_blur_size = 255;
+
+/// @brief Return \p value of job option \p key as an integer from \p min to \p max, or throw a domain error.
+static long parseJobInteger(const std::string &key, const std::string &value, long min, long max) {
+  char *end;
+  errno = 0;
+  long v = std::strtol(value.c_str(), &end, 10);
+  if (value.empty() || (*end != '\0') || (errno != 0) || (v < min) || (v > max)) {
+    throw std::domain_error("Job option " + key + " must be an integer from " + std::to_string(min) + " to "
+                                + std::to_string(max) + ".");
+  }
+  return v;
+}
+
+/// @brief Return \p value of job option \p key as a finite number, or throw a domain error.
+static float parseJobFloat(const std::string &key, const std::string &value) {
+  char *end;
+  errno = 0;
+  float v = std::strtof(value.c_str(), &end);
+  // Programs built with -ffinite-math-only assume that std::isfinite() holds, so check the exponent bits instead.
+  std::uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  if (value.empty() || (*end != '\0') || (errno != 0) || ((bits & 0x7F800000u) == 0x7F800000u)) {
+    throw std::domain_error("Job option " + key + " must be a finite number.");
+  }
+  return v;
+}
+
+ServerJob ServerJob::parse(const std::string &words) {
+  ServerJob job;
+  std::istringstream ss(words);
+  std::string word;
+  while (ss >> word) {
+    auto eq = word.find('=');
+    auto key = word.substr(0, eq);
+    auto value = (eq == std::string::npos) ? std::string() : word.substr(eq + 1);
+    if (key == "input") {
+      job.input = value;
+    } else if (key == "input_shm") {
+      job.input_shm = value;
+    } else if (key == "output") {
+      job.output = value;
+    } else if (key == "output_shm") {
+      job.output_shm = value;
+    } else if (key == "backend") {
+      job.backend = value;
+    } else if (key == "name") {
+      job.options.img_name = value;
+    } else if (key == "histogram") {
+      job.options.histogram = true;
+    } else if (key == "enhance") {
+      job.options.enhance = true;
+      job.options.histogram = true;
+    } else if (key == "enhance_hist") {
+      job.options.enhance_hist = true;
+    } else if (key == "intermediate") {
+      job.options.save_intermediate = true;
+    } else if (key == "ripple") {
+      job.options.ripple = true;
+      job.options.ripple_frequency = parseJobFloat(key, value);
+    } else if (key == "blur") {
+      job.options.blur = true;
+      job.options.blur_size = (int) parseJobInteger(key, value, 1, max_job_blur_size);
+    } else if (key == "step") {
+      job.options.ripple_map_step = (unsigned int) parseJobInteger(key, value, 1, RippleMap::max_step);
+    } else {
+      throw std::domain_error("Unknown job option " + word + ".");
+    }
+  }
+  if (job.input.empty() == job.input_shm.empty()) {
+    throw std::domain_error("Job must have either an input or a shared input.");
+  }
+  if (!job.input_shm.empty() && (job.input_shm == job.output_shm)) {
+    throw std::domain_error("Shared input and output must be different segments.");
+  }
+  if (job.options.img_name.empty()) {
+    auto input = job.input.empty() ? job.input_shm : job.input;
+    auto name = input.substr(input.find_last_of("\\/") + 1);
+    job.options.img_name = name.substr(0, name.find_last_of('.'));
+  }
+  return job;
+}
+
+std::string ServerJob::toString() const {
+  std::ostringstream ss;
+  ss << "process backend=" << backend << " name=" << options.img_name;
+  if (!input.empty()) {
+    ss << " input=" << input;
+  }
+  if (!input_shm.empty()) {
+    ss << " input_shm=" << input_shm;
+  }
+  if (!output.empty()) {
+    ss << " output=" << output;
+  }
+  if (!output_shm.empty()) {
+    ss << " output_shm=" << output_shm;
+  }
+  if (options.histogram) {
+    ss << " histogram";
+  }
+  if (options.enhance) {
+    ss << " enhance";
+  }
+  if (options.enhance_hist) {
+    ss << " enhance_hist";
+  }
+  if (options.save_intermediate) {
+    ss << " intermediate";
+  }
+  if (options.ripple) {
+    ss << " ripple=" << options.ripple_frequency;
+  }
+  if (options.blur) {
+    ss << " blur=" << options.blur_size;
+  }
+  if (options.ripple_map_step > 1) {
+    ss << " step=" << options.ripple_map_step;
+  }
+  return ss.str();
+}
+
+/// @brief Read a line from \p fd into \p line, buffering the remainder in \p buffer. Return false at end of stream.
+static bool readLine(int fd, std::string *buffer, std::string *line) {
+  size_t end;
+  while ((end = buffer->find('\n')) == std::string::npos) {
+    char chunk[4096];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer->append(chunk, (size_t) n);
+  }
+  *line = buffer->substr(0, end);
+  buffer->erase(0, end + 1);
+  if (!line->empty() && (line->back() == '\r')) {
+    line->pop_back();
+  }
+  return true;
+}
+
+/// @brief Write the line \p line to \p fd. Return false if the peer is gone.
+static bool writeLine(int fd, const std::string &line) {
+  std::string data = line + "\n";
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += (size_t) n;
+  }
+  return true;
+}
+
+/// @brief Return an address for the Unix domain socket \p path, or throw a domain error if the path is too long.
+static sockaddr_un socketAddress(const std::string &path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::domain_error("Socket path " + path + " is too long.");
+  }
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+/// @brief Run one job and return the reply line.
+static std::string runJob(const ServerJob &job, const std::string &output_dir) {
+  Timer t;
+  t.start();
+  // Shared images are mapped, not copied.
+  auto img = job.input.empty() ? openSharedImage(job.input_shm, false) : Image::fromFile(job.input);
+  std::shared_ptr<Image> dest;
+  if (!job.output_shm.empty()) {
+    dest = openSharedImage(job.output_shm, true);
+  }
+  t.stop();
+  double load_seconds = t.seconds();
+
+  const Backend *backend = (job.backend == "auto") ? selectBackend(img->width, img->height) : findBackend(job.backend);
+  if (backend == nullptr) {
+    throw std::domain_error("Unknown backend " + job.backend + ".");
+  }
+
+  WaterEffectOptions options = job.options;
+  options.report_stages = false;
+  options.output_dir = output_dir;
+  t.start();
+  std::shared_ptr<Image> result;
+  if (dest != nullptr) {
+    if (runBackendInto(*backend, img.get(), &options, dest.get())) {
+      result = dest;
+    }
+  } else {
+    result = backend->run(img.get(), &options);
+  }
+  t.stop();
+  double compute_seconds = t.seconds();
+  if (result == nullptr) {
+    throw std::runtime_error("Backend " + backend->name + " produced no image.");
+  }
+
+  double save_seconds = 0.0;
+  if (!job.output.empty()) {
+    t.start();
+    if (result->toFile(job.output) != 0) {
+      throw std::runtime_error("Could not write " + job.output + ".");
+    }
+    t.stop();
+    save_seconds = t.seconds();
+  }
+  // Intermediate images are written in the background, but should be complete once the client gets the reply.
+  ImageWriter::instance().drain();
+
+  std::ostringstream reply;
+  reply << "ok backend=" << backend->name << " load=" << load_seconds << " compute=" << compute_seconds
+        << " save=" << save_seconds;
+  return reply.str();
+}
+
+void runServer(const std::string &socket_path, const std::string &output_dir) {
+  auto address = socketAddress(socket_path);
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    throw std::runtime_error("Could not create socket.");
+  }
+  unlink(socket_path.c_str());
+  if ((bind(listener, (sockaddr *) &address, sizeof(address)) != 0) || (listen(listener, 16) != 0)) {
+    std::string reason = std::strerror(errno);
+    close(listener);
+    throw std::runtime_error("Could not listen on " + socket_path + ": " + reason);
+  }
+  std::cerr << "Serving on " << socket_path << "." << std::endl;
+
+  std::atomic<bool> stopping{false};
+  // Connected clients, each served by a detached thread that removes its client when done.
+  std::mutex clients_mutex;
+  std::condition_variable clients_done;
+  std::vector<int> clients;
+
+  auto serve = [&](int client) {
+    std::string buffer;
+    std::string line;
+    while (readLine(client, &buffer, &line)) {
+      std::string command = line.substr(0, line.find(' '));
+      std::string reply;
+      if (command == "quit") {
+        reply = "ok";
+        stopping = true;
+        // Wake up the thread blocked in accept().
+        shutdown(listener, SHUT_RDWR);
+      } else if (command == "process") {
+        try {
+          reply = runJob(ServerJob::parse(line.substr(command.size())), output_dir);
+        } catch (const std::exception &e) {
+          reply = std::string("error ") + e.what();
+        }
+      } else {
+        reply = "error Unknown command " + command + ".";
+      }
+      if (!writeLine(client, reply) || stopping) {
+        break;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(clients_mutex);
+      clients.erase(std::find(clients.begin(), clients.end(), client));
+      clients_done.notify_all();
+    }
+    close(client);
+  };
+
+  while (!stopping) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    clients.push_back(client);
+    std::thread(serve, client).detach();
+  }
+
+  // Disconnect idle clients, and let running jobs complete.
+  {
+    std::unique_lock<std::mutex> lock(clients_mutex);
+    for (int client : clients) {
+      shutdown(client, SHUT_RD);
+    }
+    clients_done.wait(lock, [&]() { return clients.empty(); });
+  }
+  close(listener);
+  unlink(socket_path.c_str());
+}
+
+std::string sendServerRequest(const std::string &socket_path, const std::string &request) {
+  auto address = socketAddress(socket_path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((fd < 0) || (connect(fd, (sockaddr *) &address, sizeof(address)) != 0)) {
+    std::string reason = std::strerror(errno);
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw std::runtime_error("Could not connect to " + socket_path + ": " + reason);
+  }
+  std::string buffer;
+  std::string reply;
+  bool ok = writeLine(fd, request) && readLine(fd, &buffer, &reply);
+  close(fd);
+  if (!ok) {
+    throw std::runtime_error("Server closed the connection.");
+  }
+  return reply;
+}
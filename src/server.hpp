@@ -0,0 +1,70 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <string>
+
+#include "baseline/water.hpp"
+
+/**
+ * @brief A water effect job, as sent to the server.
+ *
+ * Jobs are sent as one line of space-separated words: the command "process", followed by any of:
+ *
+ *   input=PATH    The PNG or PAM image to process.
+ *   input_shm=S   The shared image to process, instead of a PNG image. See SharedImage.hpp.
+ *   output=PATH   Where to write the result, as PAM if the extension is .pam or .rgba, or as PNG otherwise.
+ *   output_shm=S  The shared image to write the result into, without copying it. It must have the dimensions of
+ *                 the input. Without an output, the result is discarded.
+ *   backend=NAME  The backend to run, or "auto" (default).
+ *   name=NAME     The name of intermediate images (default: the input name without extension).
+ *   histogram, enhance, enhance_hist, intermediate
+ *                 Enable a stage or option, like -m, -e, -n and -i do.
+ *   ripple=R      Ripple effect with frequency R.
+ *   blur=G        Gaussian blur with kernel size GxG.
+ *   step=L        Interpolate ripple maps from a grid of every L-th pixel.
+ *
+ * Paths cannot contain spaces. The server answers every line with one line: "ok" followed by timings, or "error"
+ * followed by a message. The command "quit" stops the server.
+ */
+struct ServerJob {
+  std::string input;
+  std::string input_shm;
+  std::string output;
+  std::string output_shm;
+  std::string backend = "auto";
+  WaterEffectOptions options;
+
+  /// @brief Parse the words following the "process" command. A domain error is thrown for unknown words and for
+  /// numeric options that are malformed or out of range.
+  static ServerJob parse(const std::string &words);
+
+  /// @brief Return the job as a request line, without line terminator.
+  std::string toString() const;
+};
+
+/**
+ * @brief Serve water effect jobs on the Unix domain socket \p socket_path, until a client sends "quit".
+ *
+ * The server keeps the thread pool, image pool, Gaussian kernels and ripple maps of the CPU implementation alive
+ * between jobs, so a job after the first one on images of the same size only costs decoding, pixel work and encoding.
+ * Every client is served on its own thread, and may send any number of jobs over its connection. Intermediate images
+ * of jobs are written to the directory \p output_dir.
+ */
+void runServer(const std::string &socket_path, const std::string &output_dir = "output");
+
+/// @brief Send \p request to the server listening on \p socket_path, and return its reply line.
+std::string sendServerRequest(const std::string &socket_path, const std::string &request);
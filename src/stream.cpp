@@ -0,0 +1,164 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "utils/Image.hpp"
+#include "utils/SpscRing.hpp"
+#include "utils/Timer.hpp"
+
+#include "stream.hpp"
+
+/// @brief A frame on its way through the stream.
+struct StreamFrame {
+  /// @brief Sequence number of the frame.
+  size_t number = 0;
+  /// @brief The input frame, of which the buffer is reused for later frames.
+  std::shared_ptr<Image> input;
+  /// @brief The processed frame.
+  std::shared_ptr<Image> output;
+  /// @brief When reading the frame started.
+  std::chrono::steady_clock::time_point start;
+};
+
+void StreamStats::report(std::ostream &os) const {
+  os << "Stream: " << frames << " frames in " << seconds << " s: " << frames / seconds << " frames/s." << std::endl;
+  if (latencies.empty()) {
+    return;
+  }
+  auto sorted = latencies;
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&](double p) { return sorted[(size_t) (p * (sorted.size() - 1) + 0.5)] * 1e3; };
+  os << "Stream latency: p50 " << percentile(0.5) << " ms, p90 " << percentile(0.9) << " ms, p99 "
+     << percentile(0.99) << " ms, max " << sorted.back() * 1e3 << " ms." << std::endl;
+}
+
+StreamStats runStream(std::FILE *in, std::FILE *out, const Backend *backend, const WaterEffectOptions *options,
+                      const StreamOptions &stream) {
+  if ((stream.width == 0) || (stream.height == 0)) {
+    throw std::domain_error("Stream frames must be at least one pixel wide and high.");
+  }
+
+  const unsigned int workers = std::max(1u, stream.workers);
+  const size_t in_flight = std::max(stream.frames_in_flight, (size_t) workers);
+  const size_t frame_bytes = (size_t) stream.width * stream.height * 4;
+
+  // One ring from the reader to every worker, one from every worker to the writer, and one back to the reader.
+  std::vector<std::unique_ptr<SpscRing<StreamFrame *>>> to_worker;
+  std::vector<std::unique_ptr<SpscRing<StreamFrame *>>> to_writer;
+  for (unsigned int w = 0; w < workers; w++) {
+    to_worker.emplace_back(new SpscRing<StreamFrame *>(in_flight));
+    to_writer.emplace_back(new SpscRing<StreamFrame *>(in_flight));
+  }
+  SpscRing<StreamFrame *> to_reader(in_flight);
+
+  // All frames, of which the reader creates the first in_flight ones.
+  std::vector<std::unique_ptr<StreamFrame>> frames;
+
+  StreamStats stats;
+  Timer tt;
+  tt.start();
+
+  // A frame for which the backend produced no image stops the stream. Later frames are not written.
+  std::atomic<bool> failed{false};
+  std::mutex error_mutex;
+  std::string error;
+
+  std::thread reader([&]() {
+    for (size_t number = 0; !failed; number++) {
+      StreamFrame *frame = nullptr;
+      if (!to_reader.tryPop(&frame)) {
+        if (frames.size() < in_flight) {
+          frames.emplace_back(new StreamFrame());
+          frame = frames.back().get();
+          frame->input = std::make_shared<Image>(stream.width, stream.height, Image::Uninitialized());
+        } else {
+          to_reader.pop(&frame);
+        }
+      }
+
+      frame->number = number;
+      frame->start = std::chrono::steady_clock::now();
+      size_t bytes = std::fread(frame->input->data(), 1, frame_bytes, in);
+      if (bytes < frame_bytes) {
+        if (bytes > 0) {
+          std::cerr << "Stream: ignoring incomplete last frame of " << bytes << " bytes." << std::endl;
+        }
+        break;
+      }
+      to_worker[number % workers]->push(frame);
+    }
+    for (auto &ring : to_worker) {
+      ring->close();
+    }
+  });
+
+  std::vector<std::thread> processors;
+  for (unsigned int w = 0; w < workers; w++) {
+    processors.emplace_back([&, w]() {
+      WaterEffectOptions frame_options = *options;
+      frame_options.report_stages = false;
+      StreamFrame *frame = nullptr;
+      while (to_worker[w]->pop(&frame)) {
+        if (!failed) {
+          frame_options.img_name = "frame_" + std::to_string(frame->number);
+          frame->output = backend->run(frame->input.get(), &frame_options);
+          if ((frame->output == nullptr) && !failed.exchange(true)) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            error = "Backend " + backend->name + " produced no image for frame " + std::to_string(frame->number) + ".";
+          }
+        }
+        to_writer[w]->push(frame);
+      }
+      to_writer[w]->close();
+    });
+  }
+
+  std::thread writer([&]() {
+    StreamFrame *frame = nullptr;
+    for (size_t number = 0; to_writer[number % workers]->pop(&frame); number++) {
+      if ((frame->output != nullptr) && !failed) {
+        std::fwrite(frame->output->data(), 1, frame_bytes, out);
+        std::fflush(out);
+        stats.latencies.push_back(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - frame->start).count());
+      }
+      // Release the result, which returns it to the image pool if it came from there, and recycle the input.
+      frame->output.reset();
+      to_reader.push(frame);
+    }
+  });
+
+  reader.join();
+  for (auto &p : processors) {
+    p.join();
+  }
+  writer.join();
+  tt.stop();
+  if (failed) {
+    throw std::runtime_error(error);
+  }
+
+  stats.frames = stats.latencies.size();
+  stats.seconds = tt.seconds();
+  return stats;
+}
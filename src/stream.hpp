@@ -0,0 +1,71 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "baseline/water.hpp"
+#include "backends.hpp"
+
+/// @brief Options of raw frame streaming.
+struct StreamOptions {
+  /// @brief Width of every frame.
+  unsigned int width = 0;
+  /// @brief Height of every frame.
+  unsigned int height = 0;
+  /// @brief Number of threads processing frames. Every one of them may use the thread pool, if the backend does.
+  unsigned int workers = 1;
+  /// @brief Maximum number of frames being read, processed or written at the same time.
+  size_t frames_in_flight = 8;
+};
+
+/// @brief Statistics of a stream.
+struct StreamStats {
+  /// @brief Number of frames processed.
+  size_t frames = 0;
+  /// @brief Wall time of the whole stream, in seconds.
+  double seconds = 0.0;
+  /// @brief Time from the start of reading to the end of writing every frame, in seconds.
+  std::vector<double> latencies;
+
+  /// @brief Print the frame rate and latency percentiles on some output stream.
+  void report(std::ostream &os = std::cerr) const;
+};
+
+/**
+ * @brief Apply the water effect to a stream of raw RGBA frames.
+ *
+ * Frames of options.width x options.height pixels, 4 bytes each, are read from \p in until it ends, and the results
+ * are written to \p out in the same order and format. A reader thread, the worker threads and a writer thread are
+ * connected by lock-free single-producer single-consumer rings: the reader deals the frames round-robin over the
+ * workers, and the writer collects them in the same order. The writer hands written frames back to the reader, so no
+ * frame buffer is allocated after the first frames_in_flight frames.
+ *
+ * If the backend produces no image for a frame, for example because no stage is enabled, the stream stops without
+ * writing that frame or any later one, and a runtime error is thrown.
+ *
+ * @param in      The stream to read frames from.
+ * @param out     The stream to write frames to.
+ * @param backend The backend to process the frames with.
+ * @param options The water effect options. Intermediate images are named after the frame number.
+ * @param stream  The stream options.
+ * @return        The stream statistics.
+ */
+StreamStats runStream(std::FILE *in, std::FILE *out, const Backend *backend, const WaterEffectOptions *options,
+                      const StreamOptions &stream);
@@ -0,0 +1,81 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * @brief A blocking first-in first-out queue with a fixed capacity.
+ *
+ * Producers block while the queue is full, so a fast stage cannot run ahead of a slow one and pile up items in memory.
+ * Consumers block while the queue is empty, until it is closed.
+ */
+template<typename T>
+class BoundedQueue {
+ public:
+  /// @brief Construct a new queue holding at most \p capacity items.
+  explicit BoundedQueue(size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {}
+
+  /// @brief Append \p item, waiting while the queue is full. Return false if the queue was closed.
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this]() { return closed || (items.size() < capacity); });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    lock.unlock();
+    not_empty.notify_one();
+    return true;
+  }
+
+  /// @brief Remove the first item into \p item, waiting while the queue is empty. Return false once it is closed
+  /// and empty.
+  bool pop(T *item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this]() { return closed || !items.empty(); });
+    if (items.empty()) {
+      return false;
+    }
+    *item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+    return true;
+  }
+
+  /// @brief Close the queue. Items that were pushed before can still be popped.
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+
+ private:
+  size_t capacity;
+  std::deque<T> items;
+  bool closed = false;
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+};
@@ -15,8 +15,8 @@
 #include "Image.hpp"
 #include "Histogram.hpp"
 
-int Histogram::max(int channel) const {
-  int max = 0;
+Histogram::Count Histogram::max(int channel) const {
+  Count max = 0;
 
   int cstart = 0;
   int cend = channels;
@@ -46,7 +46,7 @@ std::shared_ptr<Image> Histogram::toImage(unsigned int height_per_channel) const
   // Loop over all channels
   for (int c = 0; c < channels; c++) {
     // Find the channel maximum value to scale down the bars
-    int scale = max(c);
+    Count scale = max(c);
     // Loop over all intensities
     for (int i = 0; i < range; i++) {
 
@@ -14,36 +14,39 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include "Image.hpp"
 
 struct Histogram {
+  /// @brief Type of a count, which is 64 bits wide, so images of more than 2^31 pixels do not overflow it.
+  using Count = std::int64_t;
 
   const int channels = 4;
   const int range = 256;
 
   Histogram() : values(channels * range, 0) {}
 
-  std::vector<int> values;
+  std::vector<Count> values;
 
   /// @brief Return count of pixels of intensity on a channel
-  inline int operator()(unsigned char intensity, int channel) const {
+  inline Count operator()(unsigned char intensity, int channel) const {
     assert(channel >= 0 && channel < 4);
     return values[channel * range + intensity];
   }
 
   /// @brief Return count of pixels of intensity on a channel
-  inline int count(unsigned char intensity, int channel) const {
+  inline Count count(unsigned char intensity, int channel) const {
     return operator()(intensity, channel);
   }
 
   /// @brief Access count of pixels of intensity on a channel
-  inline int &operator()(unsigned char intensity, int channel) {
+  inline Count &operator()(unsigned char intensity, int channel) {
     return values[channel * range + intensity];
   }
 
   /// @brief Access count of pixels of intensity on a channel
-  inline int &count(unsigned char intensity, int channel) {
+  inline Count &count(unsigned char intensity, int channel) {
     return operator()(intensity, channel);
   }
 
@@ -52,7 +55,7 @@ struct Histogram {
    * @param channel The color channel to obtain the maximum value from. If this is set to -1, obtain the maximum value
    *                for all channels.
    */
-  int max(int channel = -1) const;
+  Count max(int channel = -1) const;
 
   /**
    * @brief Convert the histogram to an image.
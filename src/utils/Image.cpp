@@ -12,48 +12,247 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
 #include <iomanip>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../qoi/qoi.hpp"
 
 #include "Image.hpp"
 
 Image::Image(unsigned int width, unsigned int height) : width(width), height(height) {
   // Zero-initialize the image.
-  raw = std::vector<unsigned char>(width * height * 4, 255);
+  raw = std::vector<unsigned char>((size_t) width * height * 4, 255);
   // Set the pixel pointer to the start of the raw buffer
   pixels = reinterpret_cast<Pixel *>(raw.data());
 }
 
-std::shared_ptr<Image> Image::fromPNG(const std::string &file_name) {
+Image::Image(unsigned int width, unsigned int height, Uninitialized) : width(width), height(height) {
+  // Allocate the image without writing it. A std::vector would fill it, so the buffer is held by the owner instead.
+  std::shared_ptr<unsigned char> buffer(new unsigned char[(size_t) width * height * 4],
+                                        std::default_delete<unsigned char[]>());
+  pixels = reinterpret_cast<Pixel *>(buffer.get());
+  owner = std::move(buffer);
+}
 
-  auto img = std::make_shared<Image>();
+Image::Image(unsigned int width, unsigned int height, Pixel *pixels, std::shared_ptr<void> owner)
+    : pixels(pixels), owner(std::move(owner)), width(width), height(height) {}
 
-  // Use lodepng to decode a PNG file
-  unsigned int err = lodepng::decode(img->raw, img->width, img->height, file_name, LCT_RGBA);
+std::shared_ptr<Image> Image::fromPNG(const std::string &file_name) {
 
-  // Set the pixel pointer to the start of the raw buffer
-  img->pixels = reinterpret_cast<Pixel *>(img->raw.data());
+  // Use lodepng to decode a PNG file
+  unsigned char *decoded = nullptr;
+  unsigned int width = 0;
+  unsigned int height = 0;
+  unsigned int err = lodepng_decode32_file(&decoded, &width, &height, file_name.c_str());
 
   if (err) {
+    free(decoded);
     throw std::runtime_error("Could not load image.");
   }
 
+  // Copy the decoded pixels into the raw buffer, so they are only written once.
+  auto img = std::make_shared<Image>();
+  img->width = width;
+  img->height = height;
+  img->raw.assign(decoded, decoded + img->bytes());
+  img->pixels = reinterpret_cast<Pixel *>(img->raw.data());
+  free(decoded);
+
   return img;
 }
 
-unsigned int Image::toPNG(const std::string &file_name) {
-  unsigned int ret = lodepng::encode(file_name, raw, width, height, LCT_RGBA);
+unsigned int Image::toPNG(const std::string &file_name) const {
+  unsigned int ret = lodepng_encode32_file(file_name.c_str(), data(), width, height);
   return ret;
 }
 
+/// @brief Size of the PAM header written by toPAM(), which places the pixels at a page boundary.
+static size_t pamHeaderSize() {
+  return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+std::shared_ptr<Image> Image::fromPAM(const std::string &file_name, bool copy_on_write) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  struct stat info;
+  if ((fd < 0) || (fstat(fd, &info) != 0)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw std::runtime_error("Could not load image.");
+  }
+
+  // Parse the header, which is text up to and including the ENDHDR line.
+  std::string header(std::min((size_t) info.st_size, pamHeaderSize() + 256), '\0');
+  ssize_t n = pread(fd, &header[0], header.size(), 0);
+  header.resize(n > 0 ? (size_t) n : 0);
+  auto end = header.find("\nENDHDR\n");
+  unsigned int width = 0;
+  unsigned int height = 0;
+  unsigned int depth = 0;
+  unsigned int maxval = 0;
+  std::string tupltype = "RGB_ALPHA";
+  std::istringstream lines(header.substr(0, end == std::string::npos ? 0 : end));
+  std::string line;
+  bool magic = std::getline(lines, line) && (line == "P7");
+  while (magic && std::getline(lines, line)) {
+    std::istringstream words(line);
+    std::string key;
+    words >> key;
+    if (key == "WIDTH") {
+      words >> width;
+    } else if (key == "HEIGHT") {
+      words >> height;
+    } else if (key == "DEPTH") {
+      words >> depth;
+    } else if (key == "MAXVAL") {
+      words >> maxval;
+    } else if (key == "TUPLTYPE") {
+      words >> tupltype;
+    }
+  }
+  const size_t offset = end + 8;
+  if (!magic || (end == std::string::npos) || (width == 0) || (height == 0) || (depth != 4) || (maxval != 255)
+      || (tupltype != "RGB_ALPHA") || ((size_t) info.st_size < offset + (size_t) width * height * 4)) {
+    close(fd);
+    throw std::runtime_error("Image is not an 8-bit RGB_ALPHA PAM file.");
+  }
+
+  // Pixels that do not start at a page boundary cannot be mapped, so read them.
+  if (offset % pamHeaderSize() != 0) {
+    auto img = std::make_shared<Image>(width, height, Uninitialized());
+    size_t read = 0;
+    while (read < img->bytes()) {
+      n = pread(fd, img->data() + read, img->bytes() - read, (off_t) (offset + read));
+      if (n <= 0) {
+        close(fd);
+        throw std::runtime_error("Could not load image.");
+      }
+      read += (size_t) n;
+    }
+    close(fd);
+    return img;
+  }
+
+  const size_t size = offset + (size_t) width * height * 4;
+  void *base = copy_on_write ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                             : mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("Could not map image.");
+  }
+  std::shared_ptr<void> mapping(base, [size](void *p) { munmap(p, size); });
+  auto pixels = reinterpret_cast<Pixel *>(static_cast<unsigned char *>(base) + offset);
+  return std::make_shared<Image>(width, height, pixels, mapping);
+}
+
+std::string Image::getPAMHeader(unsigned int width, unsigned int height) {
+  // Pad the header with a comment, such that ENDHDR ends the first page.
+  std::stringstream ss;
+  ss << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\n";
+  std::string header = ss.str();
+  const std::string end = "ENDHDR\n";
+  header += "#" + std::string(pamHeaderSize() - header.size() - end.size() - 2, ' ') + "\n" + end;
+  return header;
+}
+
+unsigned int Image::toPAM(const std::string &file_name) const {
+  const std::string header = getPAMHeader(width, height);
+  const size_t size = header.size() + bytes();
+  int fd = open(file_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    return (unsigned int) errno;
+  }
+  if (ftruncate(fd, (off_t) size) != 0) {
+    unsigned int error = (unsigned int) errno;
+    close(fd);
+    return error;
+  }
+  void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return (unsigned int) errno;
+  }
+  std::memcpy(base, header.data(), header.size());
+  std::memcpy(static_cast<unsigned char *>(base) + header.size(), data(), bytes());
+  munmap(base, size);
+  return 0;
+}
+
+/// @brief Return the extension of \p file_name without the dot, or an empty string if it has none.
+static std::string getExtension(const std::string &file_name) {
+  auto dot = file_name.find_last_of("./");
+  return ((dot == std::string::npos) || (file_name[dot] != '.')) ? std::string() : file_name.substr(dot + 1);
+}
+
+bool Image::isPAM(const std::string &file_name) {
+  auto ext = getExtension(file_name);
+  return (ext == "pam") || (ext == "rgba");
+}
+
+std::shared_ptr<Image> Image::fromQOI(const std::string &file_name) {
+  std::ifstream file(file_name, std::ios::binary);
+  std::vector<unsigned char> encoded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  unsigned int width = 0;
+  unsigned int height = 0;
+  if (!file || !qoiReadHeader(encoded.data(), encoded.size(), &width, &height)) {
+    throw std::runtime_error("Could not load image.");
+  }
+  auto img = std::make_shared<Image>(width, height, Uninitialized());
+  if (!qoiDecode(encoded.data(), encoded.size(), img->data())) {
+    throw std::runtime_error("Image is not a complete QOI file.");
+  }
+  return img;
+}
+
+unsigned int Image::toQOI(const std::string &file_name) const {
+  std::vector<unsigned char> encoded;
+  if (!qoiEncode(data(), width, height, &encoded)) {
+    return 1;
+  }
+  std::ofstream file(file_name, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(encoded.data()), (std::streamsize) encoded.size());
+  return file ? 0 : 1;
+}
+
+bool Image::isQOI(const std::string &file_name) {
+  return getExtension(file_name) == "qoi";
+}
+
+std::shared_ptr<Image> Image::fromFile(const std::string &file_name) {
+  if (isPAM(file_name)) {
+    return fromPAM(file_name);
+  }
+  return isQOI(file_name) ? fromQOI(file_name) : fromPNG(file_name);
+}
+
+unsigned int Image::toFile(const std::string &file_name) const {
+  if (isPAM(file_name)) {
+    return toPAM(file_name);
+  }
+  return isQOI(file_name) ? toQOI(file_name) : toPNG(file_name);
+}
+
 std::string Image::toString() {
   std::stringstream ss;
   for (int y = 0; y < height; y++) {
     for (int x = 0; x < width; x++) {
       for (int c = 0; c < colors; c++) {
-        ss << std::setw(3) << (unsigned int) pixels[(y * width + x)].colors[c]
+        ss << std::setw(3) << (unsigned int) pixels[(size_t) y * width + x].colors[c]
            << (c == colors - 1 ? "|" : ",");
       }
     }
@@ -81,7 +280,7 @@ bool Image::is_approximately_equal_to(const Image *other) const {
     }
   }
 
-  int total_pixels = width * height;
+  size_t total_pixels = (size_t) width * height;
 
   for (int c = 0; c < colors; c++) {
     auto channel_err = err[c] / total_pixels;
@@ -16,6 +16,7 @@
 
 #include <memory>
 #include <cassert>
+#include <vector>
 
 #include "../lodepng/lodepng.h"
 
@@ -37,19 +38,95 @@ struct Image {
 
   Image() = default;
 
+  ///@brief Tag to construct an image without initializing its pixels.
+  struct Uninitialized {};
+
   ///@brief Construct a new image of /p width x /p height.
   Image(unsigned int width, unsigned int height);
 
+  /**
+   * @brief Construct a new image of \p width x \p height with undefined pixel values.
+   *
+   * No memory is written, so the pages of the image are only faulted in when the pixels are first written. Use this
+   * for images of which every pixel is overwritten, preferably by the (possibly parallel) stage that produces them.
+   * The pixels are not held by \ref raw, which stays empty; use data() to access them.
+   */
+  Image(unsigned int width, unsigned int height, Uninitialized);
+
+  /**
+   * @brief Construct a new image of \p width x \p height over externally owned pixels.
+   *
+   * The pixels are neither copied nor freed by the image, so it can wrap memory such as a shared-memory segment or a
+   * mapped file. The memory must hold \p width x \p height pixels and stay valid as long as the image is used.
+   *
+   * @param width   The image width.
+   * @param height  The image height.
+   * @param pixels  The pixels, in row-major order without padding.
+   * @param owner   An optional object that keeps the memory valid, released when the image is destroyed.
+   */
+  Image(unsigned int width, unsigned int height, Pixel *pixels, std::shared_ptr<void> owner = nullptr);
+
   ///@brief Return an image loaded from a PNG file \p file_name.
   static std::shared_ptr<Image> fromPNG(const std::string &file_name);
 
   ///@brief Write the image to a PNG file \p file_name.
-  unsigned int toPNG(const std::string &file_name);
+  unsigned int toPNG(const std::string &file_name) const;
+
+  /**
+   * @brief Return an image mapped from a PAM file \p file_name, with RGB_ALPHA tuples of 8 bits per channel.
+   *
+   * If the pixel data starts at a page boundary, as it does in files written by toPAM(), the image points directly
+   * into a memory mapping of the file and nothing is read up front. Otherwise, the pixels are read into a new image.
+   * A runtime error is thrown if the file cannot be read or is not such a PAM file.
+   *
+   * @param file_name     The file name. The extension is not checked.
+   * @param copy_on_write Whether the pixels of a mapped image may be written, without changing the file. Otherwise,
+   *                      a mapped image is read-only, and writing its pixels faults.
+   */
+  static std::shared_ptr<Image> fromPAM(const std::string &file_name, bool copy_on_write = false);
+
+  /**
+   * @brief Write the image to a PAM file \p file_name, with the pixel data starting at a page boundary.
+   *
+   * The header is padded with a comment to fill the first page, so the file can be mapped by fromPAM(). The file is
+   * sized with ftruncate() and written through a shared mapping. Return zero on success, or an errno value.
+   */
+  unsigned int toPAM(const std::string &file_name) const;
+
+  ///@brief Return the PAM header written by toPAM() for an image of \p width x \p height, which fills the first page.
+  static std::string getPAMHeader(unsigned int width, unsigned int height);
+
+  ///@brief Return whether \p file_name has the extension of a PAM file: .pam or .rgba.
+  static bool isPAM(const std::string &file_name);
+
+  ///@brief Return an image loaded from a QOI file \p file_name. A runtime error is thrown if it cannot be read.
+  static std::shared_ptr<Image> fromQOI(const std::string &file_name);
+
+  ///@brief Write the image to a QOI file \p file_name. Return zero on success.
+  unsigned int toQOI(const std::string &file_name) const;
+
+  ///@brief Return whether \p file_name has the extension of a QOI file: .qoi.
+  static bool isQOI(const std::string &file_name);
+
+  ///@brief Return an image loaded from \p file_name, as PAM or QOI file by its extension, or as PNG file otherwise.
+  static std::shared_ptr<Image> fromFile(const std::string &file_name);
+
+  ///@brief Write the image to \p file_name, as PAM or QOI file by its extension, or as PNG file otherwise.
+  unsigned int toFile(const std::string &file_name) const;
+
+  ///@brief Return the pixels as raw bytes, whether they are owned by the image or not.
+  inline unsigned char *data() { return reinterpret_cast<unsigned char *>(pixels); }
+
+  ///@brief Return the pixels as raw bytes, whether they are owned by the image or not.
+  inline const unsigned char *data() const { return reinterpret_cast<const unsigned char *>(pixels); }
+
+  ///@brief Return the size of the pixels in bytes.
+  inline size_t bytes() const { return (size_t) width * height * 4; }
 
   ///@brief Return a single pixel value
   inline Pixel operator()(int x, int y) const {
     assert((x < width) && (y < height));
-    return pixels[y * width + x];
+    return pixels[(size_t) y * width + x];
   }
 
   ///@brief Return a single pixel value
@@ -60,7 +137,7 @@ struct Image {
   ///@brief Access a single pixel
   inline Pixel &operator()(int x, int y) {
     assert((x < width) && (y < height));
-    return pixels[y * width + x];
+    return pixels[(size_t) y * width + x];
   }
 
   ///@brief Access a single pixel value
@@ -75,8 +152,12 @@ struct Image {
   Pixel *pixels = nullptr;
 
   /// @brief Raw buffer; you probably want to use the contents of this buffer on your CUDA device.
+  /// Empty for uninitialized images and images over external pixels; use data() to access the pixels of any image.
   std::vector<unsigned char> raw;
 
+  /// @brief Keeps externally owned or uninitialized pixels valid, if any.
+  std::shared_ptr<void> owner;
+
   /// @brief Width of the image
   unsigned int width = 0;
 
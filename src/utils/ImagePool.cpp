@@ -0,0 +1,175 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "ImagePool.hpp"
+
+ImagePool::ImagePool(size_t capacity, size_t max_bytes) : state(std::make_shared<State>()) {
+  state->capacity = capacity;
+  state->max_bytes = max_bytes;
+}
+
+ImagePool &ImagePool::instance() {
+  static ImagePool pool;
+  return pool;
+}
+
+void ImagePool::State::evict() {
+  // Both lists are in the order the buffers were returned, so the least recently returned one is at one of the fronts.
+  while ((free_bytes > max_bytes) && !(free.empty() && free_padded.empty())) {
+    if (free_padded.empty() || (!free.empty() && (free.front().returned < free_padded.front().returned))) {
+      free_bytes -= free.front().bytes;
+      delete free.front().buffer;
+      free.erase(free.begin());
+    } else {
+      free_bytes -= free_padded.front().bytes;
+      delete free_padded.front().buffer;
+      free_padded.erase(free_padded.begin());
+    }
+  }
+}
+
+void ImagePool::State::clear() {
+  for (auto &f : free) {
+    delete f.buffer;
+  }
+  free.clear();
+  for (auto &f : free_padded) {
+    delete f.buffer;
+  }
+  free_padded.clear();
+  free_bytes = 0;
+}
+
+template<typename T, typename Match, typename Create>
+std::shared_ptr<T> ImagePool::acquireFrom(std::vector<Free<T>> State::*free, size_t bytes, Match match, Create create) {
+  T *img = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto &list = (*state).*free;
+    for (auto i = list.begin(); i != list.end(); i++) {
+      if (match(i->buffer)) {
+        img = i->buffer;
+        state->free_bytes -= i->bytes;
+        list.erase(i);
+        state->stats.reuses++;
+        break;
+      }
+    }
+    if (img == nullptr) {
+      state->stats.allocations++;
+    }
+    state->in_use++;
+    state->stats.peak_in_use = std::max(state->stats.peak_in_use, state->in_use);
+  }
+
+  if (img == nullptr) {
+    img = create();
+  }
+
+  // Return the buffer to the pool when the last reference is dropped, unless the pool is full.
+  std::shared_ptr<State> s = state;
+  return std::shared_ptr<T>(img, [s, free, bytes, match](T *released) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->in_use--;
+    auto &list = (*s).*free;
+    size_t same_size = 0;
+    for (auto &f : list) {
+      same_size += match(f.buffer);
+    }
+    if ((same_size < s->capacity) && (bytes <= s->max_bytes)) {
+      list.push_back(Free<T>{released, bytes, s->returns++});
+      s->free_bytes += bytes;
+      s->evict();
+    } else {
+      delete released;
+    }
+  });
+}
+
+std::shared_ptr<Image> ImagePool::acquire(unsigned int width, unsigned int height) {
+  return acquireFrom(
+      &State::free, (size_t) width * height * sizeof(Pixel),
+      [width, height](const Image *img) { return (img->width == width) && (img->height == height); },
+      [width, height]() { return new Image(width, height, Image::Uninitialized()); });
+}
+
+std::shared_ptr<PaddedImage> ImagePool::acquirePadded(unsigned int width, unsigned int height, unsigned int halo) {
+  return acquireFrom(
+      &State::free_padded, PaddedImage::getPitch(width, halo) * (height + 2 * (size_t) halo),
+      [width, height, halo](const PaddedImage *img) {
+        return (img->width == width) && (img->height == height) && (img->halo == halo);
+      },
+      [width, height, halo]() { return new PaddedImage(width, height, halo); });
+}
+
+void ImagePool::clear() {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->clear();
+}
+
+ImagePool::Stats ImagePool::stats() const {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return state->stats;
+}
+
+void ImagePool::resetStats() {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->stats = Stats();
+  state->stats.peak_in_use = state->in_use;
+}
+
+void ImagePool::report(std::ostream &os) const {
+  auto s = stats();
+  os << "Image pool: " << s.allocations << " allocations, " << s.reuses << " reuses, " << s.peak_in_use
+     << " buffers in use at most." << std::endl;
+}
+
+size_t getPeakRSS() {
+  // VmHWM in /proc/self/status can be reset, unlike the maximum reported by getrusage().
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::stoul(line.substr(6)) * 1024;
+    }
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // On Linux, ru_maxrss is in kilobytes.
+  return (size_t) usage.ru_maxrss * 1024;
+}
+
+void resetPeakRSS() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5" << std::flush;
+}
+
+size_t getCurrentRSS() {
+  // The second field of /proc/self/statm is the number of resident pages.
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * (size_t) sysconf(_SC_PAGESIZE);
+}
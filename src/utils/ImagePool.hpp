@@ -0,0 +1,134 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Image.hpp"
+#include "PaddedImage.hpp"
+
+/**
+ * @brief A pool of recycled image buffers.
+ *
+ * Allocating a full-size image for every stage of every frame costs a heap allocation plus a page fault per page on
+ * first touch. Images acquired from this pool return their buffer to the pool when the last reference to them is
+ * dropped, and later requests for images of the same size reuse that buffer. The contents of a recycled image are
+ * undefined, so only stages that overwrite every pixel should acquire their destination image from the pool.
+ *
+ * Padded images are recycled in the same way, for stages that copy their input into one.
+ *
+ * Free buffers are bounded per size and in total bytes. When the free buffers exceed the byte limit, the least recently
+ * returned ones are freed first, so a long-running process that sees many image sizes, such as a batch or a server,
+ * only keeps the buffers of the sizes it used last.
+ */
+struct ImagePool {
+  /// @brief Pool statistics.
+  struct Stats {
+    /// @brief Number of images that required a new allocation.
+    size_t allocations = 0;
+    /// @brief Number of images that reused a recycled buffer.
+    size_t reuses = 0;
+    /// @brief Number of buffers handed out at the same time, at most.
+    size_t peak_in_use = 0;
+  };
+
+  /// @brief Default maximum number of bytes of all free buffers together.
+  static const size_t default_max_bytes = (size_t) 1 << 30;
+
+  /**
+   * @brief Construct a new image pool.
+   * @param capacity  The maximum number of free buffers kept per image size. Others are freed when they return.
+   * @param max_bytes The maximum number of bytes of all free buffers together. The least recently returned buffers are
+   *                  freed to stay below it.
+   */
+  explicit ImagePool(size_t capacity = 4, size_t max_bytes = default_max_bytes);
+
+  /// @brief Return the process-wide image pool.
+  static ImagePool &instance();
+
+  /// @brief Return an image of \p width x \p height with undefined contents.
+  std::shared_ptr<Image> acquire(unsigned int width, unsigned int height);
+
+  /// @brief Return a padded image of \p width x \p height with a halo of \p halo pixels and undefined contents.
+  std::shared_ptr<PaddedImage> acquirePadded(unsigned int width, unsigned int height, unsigned int halo);
+
+  /// @brief Free all buffers that are not in use.
+  void clear();
+
+  /// @brief Return the pool statistics.
+  Stats stats() const;
+
+  /// @brief Reset the pool statistics.
+  void resetStats();
+
+  /// @brief Print the pool statistics on some output stream.
+  void report(std::ostream &os = std::cout) const;
+
+ private:
+  /// @brief A free buffer, in the order in which the buffers were returned.
+  template<typename T>
+  struct Free {
+    T *buffer;
+    size_t bytes;
+    std::uint64_t returned;
+  };
+
+  /// @brief State shared with the deleters of the images handed out, which may outlive the pool.
+  struct State {
+    ~State() { clear(); }
+
+    /// @brief Free the least recently returned buffers until the free buffers take at most max_bytes.
+    void evict();
+
+    /// @brief Free all free buffers.
+    void clear();
+
+    std::mutex mutex;
+    size_t capacity = 0;
+    size_t max_bytes = 0;
+    std::vector<Free<Image>> free;
+    std::vector<Free<PaddedImage>> free_padded;
+    size_t free_bytes = 0;
+    std::uint64_t returns = 0;
+    size_t in_use = 0;
+    Stats stats;
+  };
+
+  /**
+   * @brief Return a buffer of \p bytes from the free list \p free for which \p match holds, or a new one made by
+   * \p create.
+   *
+   * The buffer returns to the free list when the last reference to it is dropped, unless the list holds as many
+   * matching buffers as the capacity of the pool. Returning it may evict other free buffers.
+   */
+  template<typename T, typename Match, typename Create>
+  std::shared_ptr<T> acquireFrom(std::vector<Free<T>> State::*free, size_t bytes, Match match, Create create);
+
+  std::shared_ptr<State> state;
+};
+
+/// @brief Return the peak resident set size of this process in bytes, since the start or the last resetPeakRSS().
+size_t getPeakRSS();
+
+/// @brief Reset the peak resident set size to the current resident set size, if the kernel supports it.
+void resetPeakRSS();
+
+/// @brief Return the current resident set size of this process in bytes, or zero if it cannot be determined.
+size_t getCurrentRSS();
@@ -0,0 +1,172 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Image.hpp"
+#include "PaddedImage.hpp"
+
+/// @brief A rectangle of pixels [x, x + width) x [y, y + height).
+struct Region {
+  Region() = default;
+
+  Region(unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+      : x(x), y(y), width(width), height(height) {}
+
+  unsigned int x = 0;
+  unsigned int y = 0;
+  unsigned int width = 0;
+  unsigned int height = 0;
+
+  /// @brief Return whether the region holds no pixels.
+  inline bool empty() const { return (width == 0) || (height == 0); }
+
+  /// @brief Return whether the region lies within an image of \p w x \p h.
+  inline bool within(unsigned int w, unsigned int h) const {
+    return (x <= w) && (width <= w - x) && (y <= h) && (height <= h - y);
+  }
+
+  /// @brief Return whether \p other is the same rectangle.
+  inline bool operator==(const Region &other) const {
+    return (x == other.x) && (y == other.y) && (width == other.width) && (height == other.height);
+  }
+
+  /// @brief Return whether \p other lies within this region.
+  inline bool contains(const Region &other) const {
+    return (other.x >= x) && (other.y >= y) && (other.x + other.width <= x + width)
+        && (other.y + other.height <= y + height);
+  }
+
+  /// @brief Return this region grown by \p n pixels on every side, clipped to an image of \p w x \p h.
+  inline Region grow(unsigned int n, unsigned int w, unsigned int h) const {
+    Region r;
+    r.x = (x > n) ? x - n : 0;
+    r.y = (y > n) ? y - n : 0;
+    r.width = std::min(w, x + width + n) - r.x;
+    r.height = std::min(h, y + height + n) - r.y;
+    return r;
+  }
+};
+
+/**
+ * @brief A non-owning view of a rectangle of pixels, with rows that are \p pitch bytes apart.
+ *
+ * A view describes a whole image or a sub-rectangle of it, without copying any pixels, so functions taking views can
+ * process slices of an image in place, for example the tiles of a scheduler or a region of interest. Views are small
+ * and are passed by value. The viewed pixels must stay valid as long as the view is used.
+ *
+ * Use ImageView for pixels that are written, and ConstImageView for pixels that are only read. Both are implicitly
+ * constructed from a pointer to a whole Image or PaddedImage, and an ImageView converts to a ConstImageView.
+ */
+template<typename P>
+struct BasicImageView {
+  /// @brief The image type a view of these pixels is constructed from.
+  using ImageType = typename std::conditional<std::is_const<P>::value, const Image, Image>::type;
+
+  /// @brief The padded image type a view of these pixels is constructed from.
+  using PaddedImageType = typename std::conditional<std::is_const<P>::value, const PaddedImage, PaddedImage>::type;
+
+  /// @brief The byte type of the pixels, used to step between rows.
+  using Byte = typename std::conditional<std::is_const<P>::value, const unsigned char, unsigned char>::type;
+
+  BasicImageView() = default;
+
+  /**
+   * @brief Construct a new view of \p width x \p height pixels.
+   * @param pixels  Pixel (0, 0) of the view.
+   * @param width   The width of the view.
+   * @param height  The height of the view.
+   * @param pitch   The distance between the starts of two rows in bytes.
+   */
+  BasicImageView(P *pixels, unsigned int width, unsigned int height, size_t pitch)
+      : pixels(pixels), width(width), height(height), pitch(pitch) {}
+
+  /// @brief Construct a new view of the whole image \p image. This is implicit, so functions taking views take images.
+  BasicImageView(ImageType *image)
+      : BasicImageView(image->pixels, image->width, image->height, (size_t) image->width * sizeof(Pixel)) {}
+
+  /// @brief Construct a new view of the padded image \p image, without its halo.
+  BasicImageView(PaddedImageType *image) : BasicImageView(image->row(0), image->width, image->height, image->pitch) {}
+
+  /// @brief Construct a new read-only view from a writable view.
+  template<typename Q, typename = typename std::enable_if<std::is_convertible<Q *, P *>::value>::type>
+  BasicImageView(const BasicImageView<Q> &other)
+      : BasicImageView(other.pixels, other.width, other.height, other.pitch) {}
+
+  /// @brief Return row \p y.
+  inline P *row(int y) const { return reinterpret_cast<P *>(reinterpret_cast<Byte *>(pixels) + (size_t) y * pitch); }
+
+  /// @brief Access a single pixel.
+  inline P &operator()(int x, int y) const {
+    assert((x >= 0) && (x < (int) width) && (y >= 0) && (y < (int) height));
+    return row(y)[x];
+  }
+
+  /// @brief Access a single pixel.
+  inline P &pixel(int x, int y) const {
+    return operator()(x, y);
+  }
+
+  /// @brief Return whether the rows of the view are packed without padding between them.
+  inline bool contiguous() const { return (pitch == (size_t) width * sizeof(Pixel)) || (height <= 1); }
+
+  /**
+   * @brief Return a view of the rectangle [\p x, \p x + \p w) x [\p y, \p y + \p h) of this view.
+   *
+   * A domain error is thrown if the rectangle does not lie within this view.
+   */
+  BasicImageView sub(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+    if ((x > width) || (w > width - x) || (y > height) || (h > height - y)) {
+      throw std::domain_error("Sub-rectangle does not lie within the image view.");
+    }
+    return BasicImageView(row(y) + x, w, h, pitch);
+  }
+
+  /// @brief Return a view of region \p r of this view.
+  BasicImageView sub(const Region &r) const { return sub(r.x, r.y, r.width, r.height); }
+
+  /// @brief Pixel (0, 0) of the view.
+  P *pixels = nullptr;
+
+  /// @brief Width of the view.
+  unsigned int width = 0;
+
+  /// @brief Height of the view.
+  unsigned int height = 0;
+
+  /// @brief Distance between the starts of two rows in bytes.
+  size_t pitch = 0;
+};
+
+/// @brief A view of pixels that are written.
+using ImageView = BasicImageView<Pixel>;
+
+/// @brief A view of pixels that are only read.
+using ConstImageView = BasicImageView<const Pixel>;
+
+/// @brief Copy the pixels of \p src into \p dest, which must be of the same dimensions.
+inline void copyView(ConstImageView src, ImageView dest) {
+  if ((src.width != dest.width) || (src.height != dest.height)) {
+    throw std::domain_error("Source and destination view are not of equal dimensions.");
+  }
+  for (unsigned int y = 0; y < src.height; y++) {
+    std::copy(src.row(y), src.row(y) + src.width, dest.row(y));
+  }
+}
@@ -0,0 +1,102 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "Timer.hpp"
+
+#include "ImageWriter.hpp"
+
+ImageWriter::ImageWriter() : encoder(&ImageWriter::work, this) {}
+
+ImageWriter::~ImageWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  queued.notify_all();
+  encoder.join();
+}
+
+ImageWriter &ImageWriter::instance() {
+  static ImageWriter writer;
+  return writer;
+}
+
+void ImageWriter::write(std::shared_ptr<const Image> image, const std::string &file_name) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.emplace_back(std::move(image), file_name);
+    pending++;
+  }
+  queued.notify_one();
+}
+
+void ImageWriter::drain() {
+  wait(0);
+}
+
+void ImageWriter::wait(size_t max_pending) {
+  std::unique_lock<std::mutex> lock(mutex);
+  written.wait(lock, [this, max_pending]() { return pending <= max_pending; });
+}
+
+void ImageWriter::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    // Only stop once the queue is empty, such that everything queued before destruction is written.
+    queued.wait(lock, [this]() { return stop || !queue.empty(); });
+    if (queue.empty()) {
+      return;
+    }
+    auto job = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+
+    Timer t;
+    t.start();
+    unsigned int error = job.first->toFile(job.second);
+    t.stop();
+    if (error != 0) {
+      std::cerr << "Could not write " << job.second << " (error " << error << ")." << std::endl;
+    }
+    // Drop the reference before signaling, such that pooled buffers are returned when drain() returns.
+    job.first.reset();
+
+    lock.lock();
+    statistics.images++;
+    statistics.failures += (error != 0);
+    statistics.encode_seconds += t.seconds();
+    --pending;
+    written.notify_all();
+  }
+}
+
+ImageWriter::Stats ImageWriter::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return statistics;
+}
+
+void ImageWriter::resetStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  statistics = Stats();
+}
+
+void ImageWriter::report(std::ostream &os) const {
+  auto s = stats();
+  os << "Image writer: " << s.images << " images, " << s.encode_seconds << " s encoding";
+  if (s.failures > 0) {
+    os << ", " << s.failures << " failed";
+  }
+  os << "." << std::endl;
+}
@@ -0,0 +1,99 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "Image.hpp"
+
+/**
+ * @brief A background image encoder.
+ *
+ * Encoding an image, deflating a PNG in particular, takes longer than most stages of the pipeline. Images handed to
+ * write() are queued and encoded by a dedicated thread, so the stage that produced them continues immediately. The
+ * queue holds a reference to every image until it is written, so the caller may drop its own reference right away.
+ *
+ * Images are written with Image::toFile(), so the extension of the file name selects the format.
+ *
+ * The encoder thread does not execute pool tasks, and pool threads never wait for it, except through drain() or wait().
+ */
+class ImageWriter {
+ public:
+  /// @brief Encoder statistics.
+  struct Stats {
+    /// @brief Number of images written.
+    size_t images = 0;
+    /// @brief Number of images that could not be written.
+    size_t failures = 0;
+    /// @brief Total time spent encoding and writing, in seconds.
+    double encode_seconds = 0.0;
+  };
+
+  ImageWriter();
+
+  /// @brief Write all queued images and stop the encoder thread.
+  ~ImageWriter();
+
+  ImageWriter(const ImageWriter &) = delete;
+  ImageWriter &operator=(const ImageWriter &) = delete;
+
+  /// @brief Return the process-wide writer. Its queue is drained when the program exits.
+  static ImageWriter &instance();
+
+  /// @brief Queue \p image to be written to the file \p file_name, and return immediately.
+  void write(std::shared_ptr<const Image> image, const std::string &file_name);
+
+  /// @brief Wait until all queued images are written.
+  void drain();
+
+  /// @brief Wait until no more than \p max_pending images are queued or being written.
+  void wait(size_t max_pending);
+
+  /// @brief Return the encoder statistics since construction or the last call to resetStats().
+  Stats stats() const;
+
+  /// @brief Reset the encoder statistics.
+  void resetStats();
+
+  /// @brief Print the encoder statistics on some output stream.
+  void report(std::ostream &os = std::cout) const;
+
+ private:
+  /// @brief The main loop of the encoder thread.
+  void work();
+
+  /// @brief Images that remain to be written, with their file names.
+  std::deque<std::pair<std::shared_ptr<const Image>, std::string>> queue;
+
+  /// @brief Number of images that are queued or being written.
+  size_t pending = 0;
+
+  mutable std::mutex mutex;
+  std::condition_variable queued;
+  std::condition_variable written;
+  bool stop = false;
+  Stats statistics;
+
+  std::thread encoder;
+};
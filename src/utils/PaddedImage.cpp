@@ -0,0 +1,104 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "PaddedImage.hpp"
+
+/// @brief Number of rows per task of the copies.
+static const size_t band_rows = 64;
+
+/// @brief Return the number of bytes before pixel x = 0 of every row, which holds the left halo.
+static inline size_t getLead(unsigned int halo) {
+  return ((size_t) halo * 4 + 63) / 64 * 64;
+}
+
+size_t PaddedImage::getPitch(unsigned int width, unsigned int halo, size_t min_pitch) {
+  size_t pitch = std::max(getLead(halo) + ((size_t) width + halo) * 4, min_pitch);
+  pitch = (pitch + 63) / 64 * 64;
+  if (pitch % 4096 == 0) {
+    pitch += 64;
+  }
+  return pitch;
+}
+
+PaddedImage::PaddedImage(unsigned int width, unsigned int height, unsigned int halo, size_t min_pitch)
+    : width(width), height(height), halo(halo), pitch(getPitch(width, halo, min_pitch)) {
+  // Over-allocate, such that the first row can start at a 64-byte boundary. Every row holds the left halo in front of
+  // pixel x = 0, which is at a 64-byte boundary, and the right halo and the rest of the pitch after the image.
+  const size_t rows = (size_t) height + 2 * halo;
+  buffer.reset(new unsigned char[rows * pitch + 64]);
+  auto address = reinterpret_cast<std::uintptr_t>(buffer.get());
+  unsigned char *base = buffer.get() + ((64 - address % 64) % 64);
+  origin = base + (size_t) halo * pitch + getLead(halo);
+}
+
+void PaddedImage::fillHalo(Border border) {
+  if (halo == 0) {
+    return;
+  }
+  if ((width == 0) || (height == 0)) {
+    throw std::domain_error("Cannot replicate the edges of an empty image.");
+  }
+
+  // Left and right halo of every row.
+  for (int y = 0; y < (int) height; y++) {
+    Pixel *r = row(y);
+    const Pixel left = (border == Border::Zero) ? Pixel{0, 0, 0, 0} : r[0];
+    const Pixel right = (border == Border::Zero) ? Pixel{0, 0, 0, 0} : r[width - 1];
+    std::fill(r - halo, r, left);
+    std::fill(r + width, r + width + halo, right);
+  }
+
+  // Top and bottom halo, including the corners, which repeat the first and last row with their halo.
+  const size_t row_bytes = ((size_t) width + 2 * halo) * 4;
+  for (int y = 1; y <= (int) halo; y++) {
+    if (border == Border::Zero) {
+      std::memset(row(-y) - halo, 0, row_bytes);
+      std::memset(row(height - 1 + y) - halo, 0, row_bytes);
+    } else {
+      std::memcpy(row(-y) - halo, row(0) - halo, row_bytes);
+      std::memcpy(row(height - 1 + y) - halo, row(height - 1) - halo, row_bytes);
+    }
+  }
+}
+
+void PaddedImage::copyFrom(const Image *src, Border border, ThreadPool *pool) {
+  assert((src != nullptr) && (pool != nullptr));
+  if ((src->width != width) || (src->height != height)) {
+    throw std::domain_error("Source and padded image are not of equal dimensions.");
+  }
+  pool->parallelFor(0, height, band_rows, [&](size_t y0, size_t y1) {
+    for (size_t y = y0; y < y1; y++) {
+      std::memcpy(row((int) y), src->pixels + y * width, (size_t) width * 4);
+    }
+  });
+  fillHalo(border);
+}
+
+void PaddedImage::copyTo(Image *dest, ThreadPool *pool) const {
+  assert((dest != nullptr) && (pool != nullptr));
+  if ((dest->width != width) || (dest->height != height)) {
+    throw std::domain_error("Padded and destination image are not of equal dimensions.");
+  }
+  pool->parallelFor(0, height, band_rows, [&](size_t y0, size_t y1) {
+    for (size_t y = y0; y < y1; y++) {
+      std::memcpy(dest->pixels + y * width, row((int) y), (size_t) width * 4);
+    }
+  });
+}
@@ -0,0 +1,118 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+
+/// @brief How the halo of a padded image is filled.
+enum class Border {
+  /// @brief Halo pixels are zero, such that they do not contribute to a convolution.
+  Zero,
+  /// @brief Halo pixels repeat the nearest pixel on the edge of the image.
+  Replicate
+};
+
+/**
+ * @brief An image with 64-byte aligned rows, a configurable row pitch and an optional halo of pixels around it.
+ *
+ * Image packs rows at exactly width * 4 bytes, so rows start at arbitrary alignments and neighborhood operations have
+ * to check every access against the image bounds. Every row of a padded image starts at a 64-byte boundary, and the
+ * image is surrounded by a halo, such that pixels (x, y) with -halo <= x < width + halo and -halo <= y < height + halo
+ * can be read without bounds checks.
+ *
+ * Row pitches that are a multiple of 4 KiB map vertically adjacent pixels onto the same cache sets, which makes
+ * column-wise access patterns conflict in the caches. Such pitches are grown by one cache line.
+ */
+struct PaddedImage {
+  PaddedImage() = default;
+
+  /**
+   * @brief Construct a new padded image with undefined pixel values.
+   * @param width     The image width.
+   * @param height    The image height.
+   * @param halo      The number of halo pixels on every side of the image.
+   * @param min_pitch The minimum row pitch in bytes. The pitch is at least large enough to hold a row and its halo.
+   */
+  PaddedImage(unsigned int width, unsigned int height, unsigned int halo = 0, size_t min_pitch = 0);
+
+  PaddedImage(const PaddedImage &) = delete;
+  PaddedImage &operator=(const PaddedImage &) = delete;
+
+  /**
+   * @brief Return the row pitch of a padded image.
+   * @param width     The image width.
+   * @param halo      The number of halo pixels on every side of the image.
+   * @param min_pitch The minimum row pitch in bytes.
+   * @return          The row pitch in bytes, which is a multiple of 64 but not of 4096.
+   */
+  static size_t getPitch(unsigned int width, unsigned int halo, size_t min_pitch = 0);
+
+  /// @brief Return row \p y, which may be a halo row, pointing to pixel x = 0.
+  inline Pixel *row(int y) { return reinterpret_cast<Pixel *>(origin + (std::ptrdiff_t) y * (std::ptrdiff_t) pitch); }
+
+  /// @brief Return row \p y, which may be a halo row, pointing to pixel x = 0.
+  inline const Pixel *row(int y) const {
+    return reinterpret_cast<const Pixel *>(origin + (std::ptrdiff_t) y * (std::ptrdiff_t) pitch);
+  }
+
+  ///@brief Access a single pixel, which may be a halo pixel.
+  inline Pixel &operator()(int x, int y) {
+    assert((x >= -(int) halo) && (x < (int) (width + halo)) && (y >= -(int) halo) && (y < (int) (height + halo)));
+    return row(y)[x];
+  }
+
+  ///@brief Return a single pixel value, which may be a halo pixel.
+  inline Pixel operator()(int x, int y) const {
+    assert((x >= -(int) halo) && (x < (int) (width + halo)) && (y >= -(int) halo) && (y < (int) (height + halo)));
+    return row(y)[x];
+  }
+
+  /// @brief Fill the halo around the image from its edge pixels.
+  void fillHalo(Border border);
+
+  /**
+   * @brief Copy the pixels of \p src into this image, and fill the halo.
+   * @param src    The source image, of the same dimensions as this image.
+   * @param border How to fill the halo.
+   * @param pool   The thread pool that copies bands of rows.
+   */
+  void copyFrom(const Image *src, Border border, ThreadPool *pool = &ThreadPool::instance());
+
+  /// @brief Copy the pixels of this image without its halo into \p dest, which has the same dimensions.
+  void copyTo(Image *dest, ThreadPool *pool = &ThreadPool::instance()) const;
+
+  /// @brief Width of the image, without halo.
+  unsigned int width = 0;
+
+  /// @brief Height of the image, without halo.
+  unsigned int height = 0;
+
+  /// @brief Number of halo pixels on every side of the image.
+  unsigned int halo = 0;
+
+  /// @brief Distance between the starts of two rows in bytes.
+  size_t pitch = 0;
+
+ private:
+  std::unique_ptr<unsigned char[]> buffer;
+
+  /// @brief Pixel (0, 0).
+  unsigned char *origin = nullptr;
+};
@@ -0,0 +1,118 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "PerfCounters.hpp"
+
+#ifdef __linux__
+/// @brief Open a perf event counting on the calling thread and the threads it creates after this call.
+static int openPerfEvent(std::uint32_t type, std::uint64_t config) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/// @brief Return the perf config of a hardware cache event.
+static inline std::uint64_t cacheEvent(std::uint64_t cache, std::uint64_t op, std::uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+  for (int e = 0; e < NumEvents; e++) {
+    fds[e] = -1;
+    counts[e] = 0;
+  }
+#ifdef __linux__
+  fds[CacheReferences] = openPerfEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+  fds[CacheMisses] = openPerfEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  fds[L1DLoadMisses] = openPerfEvent(PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1D,
+                                                                     PERF_COUNT_HW_CACHE_OP_READ,
+                                                                     PERF_COUNT_HW_CACHE_RESULT_MISS));
+  fds[DTLBLoadMisses] = openPerfEvent(PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB,
+                                                                      PERF_COUNT_HW_CACHE_OP_READ,
+                                                                      PERF_COUNT_HW_CACHE_RESULT_MISS));
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int e = 0; e < NumEvents; e++) {
+    if (fds[e] >= 0) {
+      close(fds[e]);
+    }
+  }
+#endif
+}
+
+void PerfCounters::start() {
+#ifdef __linux__
+  for (int e = 0; e < NumEvents; e++) {
+    if (fds[e] >= 0) {
+      ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+void PerfCounters::stop() {
+#ifdef __linux__
+  for (int e = 0; e < NumEvents; e++) {
+    if (fds[e] >= 0) {
+      ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fds[e], &counts[e], sizeof(counts[e])) != sizeof(counts[e])) {
+        counts[e] = 0;
+      }
+    }
+  }
+#endif
+}
+
+const char *PerfCounters::name(Event e) {
+  switch (e) {
+    case CacheReferences: return "cache references";
+    case CacheMisses: return "cache misses";
+    case L1DLoadMisses: return "L1D load misses";
+    case DTLBLoadMisses: return "dTLB load misses";
+    default: return "unknown";
+  }
+}
+
+void PerfCounters::report(std::ostream &os) const {
+  for (int e = 0; e < NumEvents; e++) {
+    os << (e == 0 ? "" : ", ") << name((Event) e) << ": ";
+    if (available((Event) e)) {
+      os << counts[e];
+    } else {
+      os << "n/a";
+    }
+  }
+  os << std::endl;
+}
@@ -0,0 +1,67 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+/**
+ * @brief Hardware performance counters for cache and TLB behavior.
+ *
+ * Uses the Linux perf_event interface. Counters that the kernel or the CPU does not provide (e.g. in virtual machines
+ * or when perf_event_paranoid forbids it) are reported as unavailable rather than causing an error.
+ */
+struct PerfCounters {
+  /// @brief The events that are counted.
+  enum Event {
+    CacheReferences = 0,
+    CacheMisses,
+    L1DLoadMisses,
+    DTLBLoadMisses,
+    NumEvents
+  };
+
+  PerfCounters();
+
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  /// @brief Reset and start all available counters.
+  void start();
+
+  /// @brief Stop all counters and read their values.
+  void stop();
+
+  /// @brief Return true if event \p e could be counted.
+  inline bool available(Event e) const { return fds[e] >= 0; }
+
+  /// @brief Return the count of event \p e between the last start() and stop().
+  inline std::uint64_t count(Event e) const { return counts[e]; }
+
+  /// @brief Return the name of event \p e.
+  static const char *name(Event e);
+
+  /// @brief Print all counts on some output stream.
+  void report(std::ostream &os = std::cout) const;
+
+  /// @brief File descriptors of the perf events, or -1 if unavailable.
+  int fds[NumEvents];
+
+  /// @brief Counted values.
+  std::uint64_t counts[NumEvents];
+};
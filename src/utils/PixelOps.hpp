@@ -0,0 +1,159 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+#include "ImageView.hpp"
+
+/**
+ * Composable per-pixel operators.
+ *
+ * Every operator writes some channels of a destination pixel, computed from the source pixel only. Operators are
+ * composed with operator|, which yields an expression type, such as:
+ *
+ *   applyPixelOp(src, dest, lut(r, g, b) | passthrough(3));
+ *
+ * The expression is evaluated in a single pass over the pixels, without any intermediate image. Since the whole
+ * expression is one type, the compiler inlines all operators into the loop body. Channels that no operator writes
+ * keep their value in the destination.
+ */
+
+/// @brief A lookup table mapping every intensity of a channel to a new intensity.
+struct Lut {
+  unsigned char table[256];
+
+  /// @brief Return the new intensity of \p v.
+  inline unsigned char operator()(unsigned char v) const { return table[v]; }
+
+  /// @brief Return a table that maps every intensity onto itself.
+  static inline Lut identity() {
+    Lut l;
+    for (int v = 0; v < 256; v++) {
+      l.table[v] = (unsigned char) v;
+    }
+    return l;
+  }
+};
+
+/// @brief Base of all per-pixel operators, used to restrict the composition operators to them.
+template<typename Derived>
+struct PixelOp {
+  inline const Derived &derived() const { return static_cast<const Derived &>(*this); }
+};
+
+/// @brief Map one channel through a lookup table.
+struct LutOp : public PixelOp<LutOp> {
+  LutOp(int channel, const Lut &lut) : channel(channel), lut(lut) {}
+
+  int channel;
+  Lut lut;
+
+  inline void operator()(const Pixel &in, Pixel &out) const { out.colors[channel] = lut(in.colors[channel]); }
+};
+
+/// @brief Copy one channel from source to destination.
+struct PassthroughOp : public PixelOp<PassthroughOp> {
+  explicit PassthroughOp(int channel) : channel(channel) {}
+
+  int channel;
+
+  inline void operator()(const Pixel &in, Pixel &out) const { out.colors[channel] = in.colors[channel]; }
+};
+
+/// @brief Set one channel to a constant, for example to make the alpha channel opaque.
+struct ConstantOp : public PixelOp<ConstantOp> {
+  ConstantOp(int channel, unsigned char value) : channel(channel), value(value) {}
+
+  int channel;
+  unsigned char value;
+
+  inline void operator()(const Pixel &, Pixel &out) const { out.colors[channel] = value; }
+};
+
+/// @brief Apply two operators to the same pixel. If both write a channel, the right hand side takes precedence.
+template<typename A, typename B>
+struct ComposedOp : public PixelOp<ComposedOp<A, B>> {
+  ComposedOp(const A &a, const B &b) : a(a), b(b) {}
+
+  A a;
+  B b;
+
+  inline void operator()(const Pixel &in, Pixel &out) const {
+    a(in, out);
+    b(in, out);
+  }
+};
+
+///@brief Check if a channel is valid, or throw a domain error.
+inline int checkPixelOpChannel(int channel) {
+  if ((channel < 0) || (channel > 3)) {
+    throw std::domain_error("Color channel must be 0,1,2 or 3.");
+  }
+  return channel;
+}
+
+/// @brief Return an operator mapping channel \p channel through \p table.
+inline LutOp lut(int channel, const Lut &table) {
+  return LutOp(checkPixelOpChannel(channel), table);
+}
+
+/// @brief Return an operator mapping the red, green and blue channels through \p r, \p g and \p b.
+inline ComposedOp<ComposedOp<LutOp, LutOp>, LutOp> lut(const Lut &r, const Lut &g, const Lut &b) {
+  return ComposedOp<ComposedOp<LutOp, LutOp>, LutOp>(ComposedOp<LutOp, LutOp>(LutOp(0, r), LutOp(1, g)),
+                                                     LutOp(2, b));
+}
+
+/// @brief Return an operator copying channel \p channel.
+inline PassthroughOp passthrough(int channel) {
+  return PassthroughOp(checkPixelOpChannel(channel));
+}
+
+/// @brief Return an operator setting channel \p channel to \p value.
+inline ConstantOp constant(int channel, unsigned char value) {
+  return ConstantOp(checkPixelOpChannel(channel), value);
+}
+
+/// @brief Compose two operators into one expression.
+template<typename A, typename B>
+inline ComposedOp<A, B> operator|(const PixelOp<A> &a, const PixelOp<B> &b) {
+  return ComposedOp<A, B>(a.derived(), b.derived());
+}
+
+/// @brief Evaluate the expression \p op for \p n pixels, from \p in to \p out.
+template<typename Op>
+inline void applyPixelOp(const Pixel *in, Pixel *out, size_t n, const PixelOp<Op> &op) {
+  // Copy the expression, such that the compiler knows its lookup tables do not alias with the pixels.
+  const Op expr = op.derived();
+  for (size_t i = 0; i < n; i++) {
+    expr(in[i], out[i]);
+  }
+}
+
+/// @brief Evaluate the expression \p op for every pixel of \p src, storing the result in \p dest.
+template<typename Op>
+inline void applyPixelOp(ConstImageView src, ImageView dest, const PixelOp<Op> &op) {
+  if ((src.width != dest.width) || (src.height != dest.height)) {
+    throw std::domain_error("Source and destination image are not of equal dimensions.");
+  }
+  if (src.contiguous() && dest.contiguous()) {
+    applyPixelOp(src.pixels, dest.pixels, (size_t) src.width * src.height, op);
+    return;
+  }
+  for (unsigned int y = 0; y < src.height; y++) {
+    applyPixelOp(src.row(y), dest.row(y), src.width, op);
+  }
+}
@@ -0,0 +1,163 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "PlanarImage.hpp"
+
+/// @brief Number of pixels per task of the conversions.
+static const size_t convert_grain = 64 * 1024;
+
+PlanarImage::PlanarImage(unsigned int width, unsigned int height) : width(width), height(height) {
+  plane_stride = ((size_t) width * height + 63) / 64 * 64;
+  // Over-allocate, such that the first plane can start at a 64-byte boundary. Like Image::Uninitialized, the planes
+  // are not written, so their pages are faulted in by the stage that produces them.
+  buffer.reset(new unsigned char[plane_stride * 4 + 64]);
+  auto address = reinterpret_cast<std::uintptr_t>(buffer.get());
+  planes = buffer.get() + ((64 - address % 64) % 64);
+}
+
+///@brief Check if the dimensions of an interleaved and a planar image are equal, or throw a domain error.
+static inline void checkDimensionsEqualOrThrow(const Image *a, const PlanarImage *b) {
+  if ((a->width != b->width) || (a->height != b->height)) {
+    throw std::domain_error("Interleaved and planar image are not of equal dimensions.");
+  }
+}
+
+static inline void deinterleaveScalar(const unsigned char *in, unsigned char *r, unsigned char *g, unsigned char *b,
+                                      unsigned char *a, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    r[i] = in[i * 4];
+    g[i] = in[i * 4 + 1];
+    b[i] = in[i * 4 + 2];
+    a[i] = in[i * 4 + 3];
+  }
+}
+
+static inline void interleaveScalar(const unsigned char *r, const unsigned char *g, const unsigned char *b,
+                                    const unsigned char *a, unsigned char *out, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    out[i * 4] = r[i];
+    out[i * 4 + 1] = g[i];
+    out[i * 4 + 2] = b[i];
+    out[i * 4 + 3] = a[i];
+  }
+}
+
+#ifdef USE_X86_SIMD
+/**
+ * @brief Deinterleave pixels [begin, end) in blocks of 32 pixels, and return where the scalar remainder starts.
+ *
+ * Within every 128-bit lane, a byte shuffle transposes 4 pixels into 4 bytes per channel, and a dword permutation
+ * gathers the 8 bytes of every channel of a 256-bit load. Four such loads form a 4x4 matrix of 8-byte groups, which is
+ * transposed into 32 bytes per channel.
+ */
+__attribute__((target("avx2")))
+static size_t deinterleaveAVX2(const unsigned char *in, unsigned char *r, unsigned char *g, unsigned char *b,
+                               unsigned char *a, size_t begin, size_t end) {
+  const __m256i transpose = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                                             0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+  const __m256i gather = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  size_t i = begin;
+  for (; i + 32 <= end; i += 32) {
+    __m256i v[4];
+    for (int j = 0; j < 4; j++) {
+      auto p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + (i + j * 8) * 4));
+      v[j] = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, transpose), gather);
+    }
+    // v[j] holds the 8 bytes of red, green, blue and alpha of pixels i + 8j to i + 8j + 7.
+    __m256i t0 = _mm256_unpacklo_epi64(v[0], v[1]);
+    __m256i t1 = _mm256_unpackhi_epi64(v[0], v[1]);
+    __m256i t2 = _mm256_unpacklo_epi64(v[2], v[3]);
+    __m256i t3 = _mm256_unpackhi_epi64(v[2], v[3]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(r + i), _mm256_permute2x128_si256(t0, t2, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(g + i), _mm256_permute2x128_si256(t1, t3, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(b + i), _mm256_permute2x128_si256(t0, t2, 0x31));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), _mm256_permute2x128_si256(t1, t3, 0x31));
+  }
+  return i;
+}
+
+/// @brief Interleave pixels [begin, end) in blocks of 32 pixels, and return where the scalar remainder starts.
+__attribute__((target("avx2")))
+static size_t interleaveAVX2(const unsigned char *r, const unsigned char *g, const unsigned char *b,
+                             const unsigned char *a, unsigned char *out, size_t begin, size_t end) {
+  // The byte transposition of deinterleaveAVX2() is its own inverse, the dword permutation is not.
+  const __m256i transpose = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                                             0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+  const __m256i scatter = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+  size_t i = begin;
+  for (; i + 32 <= end; i += 32) {
+    __m256i vr = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(r + i));
+    __m256i vg = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(g + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i t0 = _mm256_permute2x128_si256(vr, vb, 0x20);
+    __m256i t1 = _mm256_permute2x128_si256(vg, va, 0x20);
+    __m256i t2 = _mm256_permute2x128_si256(vr, vb, 0x31);
+    __m256i t3 = _mm256_permute2x128_si256(vg, va, 0x31);
+    __m256i v[4] = {_mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1),
+                    _mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3)};
+    for (int j = 0; j < 4; j++) {
+      auto p = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v[j], scatter), transpose);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + (i + j * 8) * 4), p);
+    }
+  }
+  return i;
+}
+#endif
+
+void deinterleave(const Image *src, PlanarImage *dest, SimdLevel level, ThreadPool *pool) {
+  assert((src != nullptr) && (dest != nullptr) && (pool != nullptr));
+  checkDimensionsEqualOrThrow(src, dest);
+  level = std::min(level, detectSimdLevel());
+
+  const unsigned char *in = src->data();
+  unsigned char *r = dest->plane(0);
+  unsigned char *g = dest->plane(1);
+  unsigned char *b = dest->plane(2);
+  unsigned char *a = dest->plane(3);
+  pool->parallelFor(0, dest->size(), convert_grain, [&](size_t begin, size_t end) {
+#ifdef USE_X86_SIMD
+    if (level >= SimdLevel::AVX2) {
+      begin = deinterleaveAVX2(in, r, g, b, a, begin, end);
+    }
+#endif
+    deinterleaveScalar(in, r, g, b, a, begin, end);
+  });
+}
+
+void interleave(const PlanarImage *src, Image *dest, SimdLevel level, ThreadPool *pool) {
+  assert((src != nullptr) && (dest != nullptr) && (pool != nullptr));
+  checkDimensionsEqualOrThrow(dest, src);
+  level = std::min(level, detectSimdLevel());
+
+  unsigned char *out = dest->data();
+  const unsigned char *r = src->plane(0);
+  const unsigned char *g = src->plane(1);
+  const unsigned char *b = src->plane(2);
+  const unsigned char *a = src->plane(3);
+  pool->parallelFor(0, src->size(), convert_grain, [&](size_t begin, size_t end) {
+#ifdef USE_X86_SIMD
+    if (level >= SimdLevel::AVX2) {
+      begin = interleaveAVX2(r, g, b, a, out, begin, end);
+    }
+#endif
+    interleaveScalar(r, g, b, a, out, begin, end);
+  });
+}
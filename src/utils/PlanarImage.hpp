@@ -0,0 +1,82 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "Image.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * @brief An image with one contiguous plane per channel (structure of arrays).
+ *
+ * Interleaved images keep the four channels of a pixel together, so a pass over one channel uses a quarter of every
+ * cache line it loads, and SIMD loads mix channels. A planar image keeps every channel in its own plane, such that
+ * per-channel stages stream through dense bytes. Every plane starts at a 64-byte boundary.
+ */
+struct PlanarImage {
+  PlanarImage() = default;
+
+  /// @brief Construct a new planar image of \p width x \p height with undefined pixel values.
+  PlanarImage(unsigned int width, unsigned int height);
+
+  PlanarImage(const PlanarImage &) = delete;
+  PlanarImage &operator=(const PlanarImage &) = delete;
+
+  /// @brief Return the plane of channel \p channel.
+  inline unsigned char *plane(int channel) { return planes + channel * plane_stride; }
+
+  /// @brief Return the plane of channel \p channel.
+  inline const unsigned char *plane(int channel) const { return planes + channel * plane_stride; }
+
+  /// @brief Return the number of pixels per plane.
+  inline size_t size() const { return (size_t) width * height; }
+
+  /// @brief Width of the image.
+  unsigned int width = 0;
+
+  /// @brief Height of the image.
+  unsigned int height = 0;
+
+  /// @brief Distance between the starts of two planes in bytes, which is a multiple of 64.
+  size_t plane_stride = 0;
+
+ private:
+  std::unique_ptr<unsigned char[]> buffer;
+  unsigned char *planes = nullptr;
+};
+
+/**
+ * @brief Convert the interleaved image \p src into the planar image \p dest of the same dimensions.
+ * @param src   The interleaved image.
+ * @param dest  The planar image.
+ * @param level The SIMD level to use.
+ * @param pool  The thread pool that converts bands of rows.
+ */
+void deinterleave(const Image *src, PlanarImage *dest, SimdLevel level = detectSimdLevel(),
+                  ThreadPool *pool = &ThreadPool::instance());
+
+/**
+ * @brief Convert the planar image \p src into the interleaved image \p dest of the same dimensions.
+ * @param src   The planar image.
+ * @param dest  The interleaved image.
+ * @param level The SIMD level to use.
+ * @param pool  The thread pool that converts bands of rows.
+ */
+void interleave(const PlanarImage *src, Image *dest, SimdLevel level = detectSimdLevel(),
+                ThreadPool *pool = &ThreadPool::instance());
@@ -0,0 +1,96 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SharedImage.hpp"
+
+/// @brief Return the offset of the pixels in a segment, which is the first page boundary after the header.
+static size_t pixelOffset() {
+  return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+/// @brief Map \p size bytes of \p fd, and return an image over the pixels that unmaps them when it is destroyed.
+static std::shared_ptr<Image> mapSharedImage(int fd, size_t size, bool writable, const std::string &name) {
+  void *base = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid after closing the descriptor.
+  close(fd);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("Could not map shared image " + name + ": " + std::strerror(errno));
+  }
+
+  auto header = static_cast<SharedImageHeader *>(base);
+  std::shared_ptr<void> mapping(base, [size](void *p) { munmap(p, size); });
+  auto pixels = reinterpret_cast<Pixel *>(static_cast<unsigned char *>(base) + header->offset);
+  return std::make_shared<Image>(header->width, header->height, pixels, mapping);
+}
+
+std::shared_ptr<Image> createSharedImage(const std::string &name, unsigned int width, unsigned int height) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("Could not create shared image " + name + ": " + std::strerror(errno));
+  }
+
+  // Truncating to the full size yields zero pixels, without writing them.
+  const size_t size = pixelOffset() + (size_t) width * height * 4;
+  if (ftruncate(fd, (off_t) size) != 0) {
+    std::string reason = std::strerror(errno);
+    close(fd);
+    throw std::runtime_error("Could not size shared image " + name + ": " + reason);
+  }
+
+  SharedImageHeader header;
+  header.magic = SharedImageHeader::expected_magic;
+  header.width = width;
+  header.height = height;
+  header.offset = (std::uint32_t) pixelOffset();
+  if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+    std::string reason = std::strerror(errno);
+    close(fd);
+    throw std::runtime_error("Could not write shared image " + name + ": " + reason);
+  }
+
+  return mapSharedImage(fd, size, true, name);
+}
+
+std::shared_ptr<Image> openSharedImage(const std::string &name, bool writable) {
+  int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open shared image " + name + ": " + std::strerror(errno));
+  }
+
+  // Validate the header against the segment size before mapping it.
+  SharedImageHeader header;
+  struct stat info;
+  if ((pread(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) || (fstat(fd, &info) != 0)
+      || (header.magic != SharedImageHeader::expected_magic) || (header.offset < sizeof(header))
+      || ((size_t) info.st_size < header.offset + (size_t) header.width * header.height * 4)) {
+    close(fd);
+    throw std::runtime_error("Segment " + name + " is not a shared image.");
+  }
+
+  return mapSharedImage(fd, (size_t) info.st_size, writable, name);
+}
+
+void removeSharedImage(const std::string &name) {
+  shm_unlink(name.c_str());
+}
@@ -0,0 +1,62 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Image.hpp"
+
+/**
+ * @brief Images in POSIX shared-memory segments, to hand frames between local processes without copying them.
+ *
+ * A segment starts with a SharedImageHeader, and holds the pixels from the next page boundary onwards. Images
+ * returned by these functions point directly into the mapped segment, which stays mapped as long as the image exists.
+ * Names follow shm_open(): a slash followed by up to 254 characters that are not slashes.
+ */
+
+/// @brief Header at the start of a shared image segment.
+struct SharedImageHeader {
+  /// @brief Value of magic in a valid segment.
+  static const std::uint32_t expected_magic = 0x31584657;  // "WFX1"
+
+  std::uint32_t magic;
+  std::uint32_t width;
+  std::uint32_t height;
+  /// @brief Offset of the pixels from the start of the segment, in bytes.
+  std::uint32_t offset;
+};
+
+/**
+ * @brief Create a shared-memory segment \p name for an image of \p width x \p height, replacing any existing one.
+ *
+ * The pixels are zero. A runtime error is thrown if the segment cannot be created.
+ */
+std::shared_ptr<Image> createSharedImage(const std::string &name, unsigned int width, unsigned int height);
+
+/**
+ * @brief Map the image in the existing shared-memory segment \p name.
+ *
+ * A runtime error is thrown if the segment does not exist or is not a shared image.
+ *
+ * @param name      The segment name.
+ * @param writable  Whether the image is mapped for writing. Otherwise, writing its pixels faults.
+ */
+std::shared_ptr<Image> openSharedImage(const std::string &name, bool writable);
+
+/// @brief Remove the shared-memory segment \p name. Existing mappings remain valid.
+void removeSharedImage(const std::string &name);
@@ -0,0 +1,48 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#define USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/// @brief SIMD instruction set levels that vectorized kernels can be dispatched to.
+enum class SimdLevel {
+  Scalar = 0,
+  AVX2 = 1,
+  AVX512 = 2
+};
+
+/// @brief Return the highest SIMD level supported by the CPU this process runs on.
+inline SimdLevel detectSimdLevel() {
+#ifdef USE_X86_SIMD
+  static const SimdLevel level = __builtin_cpu_supports("avx512f") ? SimdLevel::AVX512
+                                 : (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? SimdLevel::AVX2
+                                 : SimdLevel::Scalar;
+  return level;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+/// @brief Return a human readable name of a SIMD level.
+inline const char *toString(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::AVX512: return "AVX-512";
+    case SimdLevel::AVX2: return "AVX2";
+    default: return "scalar";
+  }
+}
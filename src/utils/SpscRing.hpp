@@ -0,0 +1,153 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A lock-free ring buffer between exactly one producer thread and one consumer thread.
+ *
+ * The producer only writes the tail and the consumer only writes the head, so neither ever waits for a lock. The
+ * blocking push() and pop() yield the processor for a short while when the ring is full or empty, and then sleep until
+ * the other side signals progress, so idle threads do not take cores from other work. The other side only takes a
+ * lock to signal a sleeping thread.
+ */
+template<typename T>
+class SpscRing {
+ public:
+  /// @brief Construct a new ring holding at least \p capacity items. The capacity is rounded up to a power of two.
+  explicit SpscRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  /// @brief Allocate a ring on the heap, aligned such that its indices are on different cache lines.
+  static void *operator new(size_t size) {
+    void *p = nullptr;
+    if (posix_memalign(&p, alignof(SpscRing), size) != 0) {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  static void operator delete(void *p) { std::free(p); }
+
+  /// @brief Append \p item if the ring is not full. Return whether it was appended. Producer only.
+  bool tryPush(T item) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == slots.size()) {
+      return false;
+    }
+    slots[t & mask] = std::move(item);
+    tail.store(t + 1, std::memory_order_release);
+    wake();
+    return true;
+  }
+
+  /// @brief Remove the first item into \p item if the ring is not empty. Return whether one was removed. Consumer only.
+  bool tryPop(T *item) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = std::move(slots[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+    wake();
+    return true;
+  }
+
+  /// @brief Append \p item, waiting while the ring is full. Producer only.
+  void push(T item) {
+    while (!tryPush(item)) {
+      await([this]() { return tail.load(std::memory_order_relaxed) - head.load() < slots.size(); });
+    }
+  }
+
+  /// @brief Remove the first item into \p item, waiting while the ring is empty. Return false once the ring is closed
+  /// and empty. Consumer only.
+  bool pop(T *item) {
+    while (!tryPop(item)) {
+      if (closed.load(std::memory_order_acquire)) {
+        // Items pushed before closing are visible now.
+        return tryPop(item);
+      }
+      await([this]() { return (head.load(std::memory_order_relaxed) != tail.load()) || closed.load(); });
+    }
+    return true;
+  }
+
+  /// @brief Signal the consumer that no more items will be pushed. Producer only.
+  void close() {
+    closed.store(true, std::memory_order_release);
+    wake();
+  }
+
+ private:
+  /// @brief Number of times a blocking call yields before it sleeps.
+  static const int spin_limit = 64;
+
+  /// @brief Wait until \p ready returns true, first by yielding and then by sleeping.
+  template<typename Ready>
+  void await(Ready ready) {
+    for (int i = 0; i < spin_limit; i++) {
+      if (ready()) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    // Announce the sleeper before checking again. Either this check sees the progress of the other side, or the other
+    // side sees the sleeper after making progress, and signals it.
+    sleepers.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    progress.wait(lock, ready);
+    sleepers.fetch_sub(1);
+  }
+
+  /// @brief Signal the other side after making progress, if it sleeps.
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      progress.notify_all();
+    }
+  }
+
+  std::vector<T> slots;
+  size_t mask = 0;
+  std::atomic<bool> closed{false};
+  std::atomic<int> sleepers{0};
+  std::mutex mutex;
+  std::condition_variable progress;
+  // The indices are written by different threads, so keep them on different cache lines.
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
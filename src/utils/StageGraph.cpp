@@ -0,0 +1,143 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <stdexcept>
+
+#include "StageGraph.hpp"
+
+size_t StageGraph::add(const std::string &name, std::function<void()> run, const std::vector<size_t> &dependencies,
+                       bool report) {
+  for (auto d : dependencies) {
+    if (d >= stages.size()) {
+      throw std::domain_error("Stage " + name + " depends on a stage that was not added before it.");
+    }
+  }
+  Stage stage;
+  stage.name = name;
+  stage.run = std::move(run);
+  stage.dependencies = dependencies;
+  stage.report = report;
+  stages.push_back(stage);
+  return stages.size() - 1;
+}
+
+void StageGraph::execute(ThreadPool *pool) {
+  using clock = std::chrono::steady_clock;
+  assert(pool != nullptr);
+
+  const size_t n = stages.size();
+
+  // Invert the dependencies, and count the dependencies that every stage still waits for.
+  std::vector<std::vector<size_t>> dependents(n);
+  std::unique_ptr<std::atomic<size_t>[]> waiting(new std::atomic<size_t>[n]);
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < n; i++) {
+    // Clear the timing of the previous execution, so stages skipped after a failure do not report it.
+    stages[i].start = 0.0;
+    stages[i].stop = 0.0;
+    waiting[i] = stages[i].dependencies.size();
+    for (auto d : stages[i].dependencies) {
+      dependents[d].push_back(i);
+    }
+    if (stages[i].dependencies.empty()) {
+      ready.push_back(i);
+    }
+  }
+
+  const auto start = clock::now();
+  auto since_start = [&]() { return std::chrono::duration<double>(clock::now() - start).count(); };
+
+  // Run every stage, and spawn the dependents that it was the last dependency of.
+  try {
+    pool->runDynamic(ready, [&](size_t i, const ThreadPool::Spawn &spawn) {
+      stages[i].start = since_start();
+      try {
+        stages[i].run();
+      } catch (...) {
+        stages[i].stop = since_start();
+        throw;
+      }
+      stages[i].stop = since_start();
+      for (auto d : dependents[i]) {
+        if (--waiting[d] == 0) {
+          spawn(d);
+        }
+      }
+    });
+  } catch (...) {
+    seconds = since_start();
+    throw;
+  }
+
+  seconds = since_start();
+}
+
+double StageGraph::criticalPath(std::vector<size_t> *path) const {
+  // Stages are added after their dependencies, so this is a topological order.
+  std::vector<double> finish(stages.size(), 0.0);
+  std::vector<size_t> previous(stages.size(), stages.size());
+  size_t last = stages.size();
+  for (size_t i = 0; i < stages.size(); i++) {
+    if (stages[i].stop == 0.0) {
+      // The stage was skipped, and so were its dependents.
+      continue;
+    }
+    for (auto d : stages[i].dependencies) {
+      if (finish[d] > finish[i]) {
+        finish[i] = finish[d];
+        previous[i] = d;
+      }
+    }
+    finish[i] += stages[i].stop - stages[i].start;
+    if ((last == stages.size()) || (finish[i] > finish[last])) {
+      last = i;
+    }
+  }
+
+  if (last == stages.size()) {
+    return 0.0;
+  }
+
+  if (path != nullptr) {
+    path->clear();
+    for (size_t i = last; i < stages.size(); i = previous[i]) {
+      path->push_back(i);
+    }
+    std::reverse(path->begin(), path->end());
+  }
+  return finish[last];
+}
+
+void StageGraph::report(std::ostream &os) const {
+  for (const auto &stage : stages) {
+    if (stage.report) {
+      os << "Stage: " << std::left << std::setw(18) << (stage.name + ":") << std::right
+         << (stage.stop - stage.start) << " s." << std::endl;
+    }
+  }
+
+  std::vector<size_t> path;
+  double length = criticalPath(&path);
+  os << "Critical path:           " << length << " s (";
+  for (size_t i = 0; i < path.size(); i++) {
+    os << (i > 0 ? " -> " : "") << stages[path[i]].name;
+  }
+  os << "), wall time " << seconds << " s." << std::endl;
+}
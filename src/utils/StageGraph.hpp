@@ -0,0 +1,82 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+/**
+ * @brief A dependency graph of pipeline stages.
+ *
+ * Stages are added with the stages they depend on, which must have been added before. The executor runs every stage
+ * as soon as all of its dependencies are done, so independent stages run concurrently on the thread pool.
+ */
+struct StageGraph {
+  /// @brief A stage of the graph.
+  struct Stage {
+    /// @brief Name of the stage, used when reporting.
+    std::string name;
+    /// @brief The work of the stage.
+    std::function<void()> run;
+    /// @brief Indices of the stages this stage depends on.
+    std::vector<size_t> dependencies;
+    /// @brief Whether this stage is reported on its own. Stages that only save or render results are not.
+    bool report = true;
+    /// @brief Start time of the last execution, in seconds since the start of the execution of the graph.
+    /// Zero if the stage was skipped in the last execution.
+    double start = 0.0;
+    /// @brief Stop time of the last execution, in seconds since the start of the execution of the graph.
+    /// Zero if the stage was skipped in the last execution.
+    double stop = 0.0;
+  };
+
+  /// @brief The stages, in order of addition.
+  std::vector<Stage> stages;
+
+  /// @brief Wall-clock time of the last execution in seconds.
+  double seconds = 0.0;
+
+  /**
+   * @brief Add a stage to the graph.
+   * @param name         The name of the stage.
+   * @param run          The work of the stage.
+   * @param dependencies The indices of the stages that must complete before this stage starts.
+   * @param report       Whether the stage is reported on its own.
+   * @return             The index of the new stage.
+   */
+  size_t add(const std::string &name, std::function<void()> run, const std::vector<size_t> &dependencies = {},
+             bool report = true);
+
+  /// @brief Execute all stages on \p pool. If a stage throws, its dependents are skipped and the exception rethrown.
+  void execute(ThreadPool *pool = &ThreadPool::instance());
+
+  /**
+   * @brief Return the critical path of the last execution.
+   *
+   * This is the chain of dependent stages with the largest total duration, which bounds the execution time no matter
+   * how many threads are available. Stages skipped after a stage threw are not part of it.
+   *
+   * @param path If not null, the indices of the stages on the critical path are stored here.
+   * @return     The total duration of the critical path in seconds.
+   */
+  double criticalPath(std::vector<size_t> *path = nullptr) const;
+
+  /// @brief Print the duration of every reported stage and the critical path of the last execution.
+  void report(std::ostream &os = std::cout) const;
+};
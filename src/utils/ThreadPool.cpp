@@ -0,0 +1,333 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <stdexcept>
+
+#include "ThreadPool.hpp"
+
+struct ThreadPool::Batch {
+  /// @brief The function to execute for every index.
+  const std::function<void(size_t)> *task;
+  /// @brief Number of tasks that did not complete yet.
+  std::atomic<size_t> pending;
+  /// @brief The first exception thrown by a task, if any.
+  std::exception_ptr error;
+  std::mutex error_mutex;
+};
+
+/// @brief The pool the current thread is a worker of, if any.
+static thread_local const ThreadPool *current_pool = nullptr;
+
+/// @brief The worker index of the current thread within current_pool.
+static thread_local size_t current_worker = 0;
+
+/// @brief Size of the process-wide pool, as set by ThreadPool::configure().
+static unsigned int instance_threads = 0;
+
+/// @brief Whether the process-wide pool has been created.
+static std::atomic<bool> instance_created(false);
+
+ThreadPool::ThreadPool(unsigned int threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // The submitting thread executes tasks as well, so one thread less needs to be spawned.
+  for (unsigned int i = 1; i < threads; i++) {
+    queues.emplace_back(new Queue);
+  }
+  for (size_t i = 0; i < queues.size(); i++) {
+    workers.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stop = true;
+  }
+  wake.notify_all();
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+ThreadPool &ThreadPool::instance() {
+  static ThreadPool pool((instance_created = true, instance_threads));
+  return pool;
+}
+
+void ThreadPool::configure(unsigned int threads) {
+  if (instance_created) {
+    throw std::runtime_error("Cannot configure the thread pool after it has been created.");
+  }
+  instance_threads = threads;
+}
+
+void ThreadPool::work(size_t id) {
+  using clock = std::chrono::steady_clock;
+
+  current_pool = this;
+  current_worker = id;
+
+  while (true) {
+    Task task;
+    if (take(id, &task)) {
+      execute(task);
+      continue;
+    }
+
+    // Nothing to do; sleep until tasks are pushed or the pool is destroyed.
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    if (stop) {
+      return;
+    }
+    if (queued > 0) {
+      continue;
+    }
+    auto idle_start = clock::now();
+    wake.wait(lock, [this]() { return stop || (queued > 0); });
+    idle_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - idle_start).count();
+  }
+}
+
+bool ThreadPool::take(size_t self, Task *task) {
+  const size_t n = queues.size();
+
+  // Pop the most recently pushed task from the own deque, which is most likely to still be in the cache.
+  if (self < n) {
+    Queue &q = *queues[self];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      *task = q.tasks.back();
+      q.tasks.pop_back();
+      queued--;
+      return true;
+    }
+  }
+
+  // Steal the oldest task of another deque.
+  const size_t start = (self < n) ? self + 1 : next_queue.load();
+  for (size_t k = 0; k < n; k++) {
+    const size_t victim = (start + k) % n;
+    if (victim == self) {
+      continue;
+    }
+    Queue &q = *queues[victim];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      *task = q.tasks.front();
+      q.tasks.pop_front();
+      queued--;
+      num_steals++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::execute(const Task &task) {
+  Batch *batch = task.batch;
+  try {
+    (*batch->task)(task.index);
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(batch->error_mutex);
+    if (batch->error == nullptr) {
+      batch->error = std::current_exception();
+    }
+  }
+  num_tasks++;
+  // The submitting thread may destroy the batch as soon as this reaches zero, so it must not be touched afterwards.
+  if (batch->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    // Wake up the submitting thread, if it sleeps in wait().
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+  }
+}
+
+void ThreadPool::push(Batch *batch, size_t begin, size_t end) {
+  const size_t n = queues.size();
+  const size_t self = (current_pool == this) ? current_worker : n;
+  const size_t count = end - begin;
+
+  // A worker pushes tasks onto its own deque, from which idle workers steal. Another thread spreads the tasks in
+  // contiguous chunks over all deques. Tasks are pushed in reverse, such that owners pop them in increasing order.
+  queued += count;
+  if (self < n) {
+    Queue &q = *queues[self];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    for (size_t i = end; i-- > begin;) {
+      q.tasks.push_back(Task{batch, i});
+    }
+  } else {
+    const size_t first = next_queue++ % n;
+    for (size_t c = 0; c < n; c++) {
+      Queue &q = *queues[(first + c) % n];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      for (size_t i = begin + (c + 1) * count / n; i-- > begin + c * count / n;) {
+        q.tasks.push_back(Task{batch, i});
+      }
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+  }
+  wake.notify_all();
+}
+
+void ThreadPool::wait(Batch *batch) {
+  const size_t self = (current_pool == this) ? current_worker : queues.size();
+
+  // Help executing tasks until the whole batch is done. Without tasks to help with, yield for a while, and then sleep
+  // until tasks are pushed or the batch is done, rather than spinning for as long as the remaining tasks take.
+  int spins = 0;
+  while (batch->pending.load(std::memory_order_acquire) > 0) {
+    Task t;
+    if (take(self, &t)) {
+      execute(t);
+      spins = 0;
+    } else if (spins < spin_limit) {
+      spins++;
+      std::this_thread::yield();
+    } else {
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      wake.wait(lock, [this, batch]() {
+        return (batch->pending.load(std::memory_order_acquire) == 0) || (queued > 0);
+      });
+      spins = 0;
+    }
+  }
+
+  if (batch->error != nullptr) {
+    std::rethrow_exception(batch->error);
+  }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> &task) {
+  if (count == 0) {
+    return;
+  }
+
+  // Without workers, or with a single task, there is nothing to distribute.
+  if (queues.empty() || (count == 1)) {
+    for (size_t i = 0; i < count; i++) {
+      task(i);
+    }
+    num_tasks += count;
+    return;
+  }
+
+  Batch batch;
+  batch.task = &task;
+  batch.pending = count;
+  push(&batch, 0, count);
+  wait(&batch);
+}
+
+void ThreadPool::runDynamic(const std::vector<size_t> &initial,
+                            const std::function<void(size_t, const Spawn &)> &task) {
+  // Without workers, spawned tasks are kept in a work list.
+  if (queues.empty()) {
+    std::deque<size_t> work(initial.begin(), initial.end());
+    Spawn spawn = [&](size_t i) { work.push_back(i); };
+    while (!work.empty()) {
+      size_t i = work.front();
+      work.pop_front();
+      task(i, spawn);
+      num_tasks++;
+    }
+    return;
+  }
+
+  Batch batch;
+  std::vector<size_t> indices(initial);
+
+  // Tasks are pushed by position in the indices, which spawned tasks are appended to.
+  std::mutex indices_mutex;
+  Spawn spawn = [&](size_t i) {
+    size_t position;
+    {
+      std::lock_guard<std::mutex> lock(indices_mutex);
+      position = indices.size();
+      indices.push_back(i);
+    }
+    // The spawning task is still pending, so the batch cannot complete before this task is pushed.
+    batch.pending++;
+    push(&batch, position, position + 1);
+  };
+  std::function<void(size_t)> run_task = [&](size_t position) {
+    size_t i;
+    {
+      std::lock_guard<std::mutex> lock(indices_mutex);
+      i = indices[position];
+    }
+    task(i, spawn);
+  };
+
+  batch.task = &run_task;
+  batch.pending = indices.size();
+  if (!indices.empty()) {
+    push(&batch, 0, indices.size());
+  }
+  wait(&batch);
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body) {
+  if (end <= begin) {
+    return;
+  }
+  grain = (grain == 0) ? 1 : grain;
+  run((end - begin + grain - 1) / grain, [&](size_t i) {
+    body(begin + i * grain, std::min(end, begin + (i + 1) * grain));
+  });
+}
+
+void ThreadPool::parallelFor2D(unsigned int width, unsigned int height, unsigned int tile_width,
+                               unsigned int tile_height, const std::function<void(int, int, int, int)> &body) {
+  if ((tile_width == 0) || (tile_height == 0)) {
+    throw std::domain_error("Tile size must be positive.");
+  }
+  const size_t tiles_x = (width + tile_width - 1) / tile_width;
+  const size_t tiles_y = (height + tile_height - 1) / tile_height;
+  run(tiles_x * tiles_y, [&](size_t i) {
+    const unsigned int x0 = (unsigned int) (i % tiles_x) * tile_width;
+    const unsigned int y0 = (unsigned int) (i / tiles_x) * tile_height;
+    body(x0, std::min(x0 + tile_width, width), y0, std::min(y0 + tile_height, height));
+  });
+}
+
+ThreadPool::Stats ThreadPool::stats() const {
+  Stats s;
+  s.threads = size();
+  s.tasks = num_tasks;
+  s.steals = num_steals;
+  s.idle_seconds = idle_nanoseconds * 1e-9;
+  return s;
+}
+
+void ThreadPool::resetStats() {
+  num_tasks = 0;
+  num_steals = 0;
+  idle_nanoseconds = 0;
+}
+
+void ThreadPool::report(std::ostream &os) const {
+  auto s = stats();
+  os << "Thread pool: " << s.threads << " threads, " << s.tasks << " tasks, " << s.steals << " steals, "
+     << s.idle_seconds << " s idle." << std::endl;
+}
@@ -0,0 +1,223 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A work-stealing thread pool.
+ *
+ * Every worker thread owns a task deque. Workers pop tasks from the back of their own deque, and steal from the front
+ * of the deques of other workers when their own deque is empty. A thread that submits work does not just wait for it
+ * to complete, but helps executing tasks, so submitting work from within a task does not deadlock.
+ *
+ * A pool of size one has no worker threads and executes all work on the calling thread.
+ */
+class ThreadPool {
+ public:
+  /// @brief Scheduler statistics.
+  struct Stats {
+    /// @brief Number of threads that execute tasks, including the submitting thread.
+    unsigned int threads = 0;
+    /// @brief Number of tasks executed.
+    std::uint64_t tasks = 0;
+    /// @brief Number of tasks executed by another thread than the one whose deque they were pushed to.
+    std::uint64_t steals = 0;
+    /// @brief Total time worker threads have been waiting for work, in seconds.
+    double idle_seconds = 0.0;
+  };
+
+  /**
+   * @brief Construct a new thread pool.
+   * @param threads The number of threads that execute tasks, including the submitting thread. Zero selects the number
+   *                of hardware threads.
+   */
+  explicit ThreadPool(unsigned int threads = 0);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief Return the process-wide thread pool, which is created on first use and shared by all stages.
+   *
+   * Its size is the number of hardware threads, unless configured otherwise with configure().
+   */
+  static ThreadPool &instance();
+
+  /**
+   * @brief Set the size of the process-wide thread pool.
+   *
+   * This must be called before the first call to instance(), or a runtime error is thrown.
+   *
+   * @param threads The number of threads. Zero selects the number of hardware threads.
+   */
+  static void configure(unsigned int threads);
+
+  /// @brief Return the number of threads that execute tasks, including the submitting thread.
+  unsigned int size() const { return (unsigned int) queues.size() + 1; }
+
+  /**
+   * @brief Execute \p task for every index in [0, \p count), and wait until all of them are done.
+   *
+   * If any task throws, the first exception is rethrown after all tasks completed.
+   */
+  void run(size_t count, const std::function<void(size_t)> &task);
+
+  /// @brief Function through which a task of runDynamic() spawns another task.
+  using Spawn = std::function<void(size_t)>;
+
+  /**
+   * @brief Execute \p task for every index in \p initial, and for every index spawned by a task, until all are done.
+   *
+   * Every task is passed a Spawn function, through which it can spawn tasks for other indices. This allows executing
+   * a dependency graph, where a task spawns its dependents once all their dependencies are done. If any task throws,
+   * the first exception is rethrown after all spawned tasks completed.
+   */
+  void runDynamic(const std::vector<size_t> &initial, const std::function<void(size_t, const Spawn &)> &task);
+
+  /**
+   * @brief Execute \p body on consecutive subranges of [\p begin, \p end) of at most \p grain elements.
+   * @param begin The first index.
+   * @param end   One past the last index.
+   * @param grain The maximum number of elements per task.
+   * @param body  The function to execute with the begin and end of every subrange.
+   */
+  void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+  /**
+   * @brief Execute \p body on every tile of a 2D range of \p width x \p height.
+   * @param width       The width of the range.
+   * @param height      The height of the range.
+   * @param tile_width  The width of a tile.
+   * @param tile_height The height of a tile.
+   * @param body        The function to execute with x0, x1, y0 and y1 of every tile [x0, x1) x [y0, y1).
+   */
+  void parallelFor2D(unsigned int width, unsigned int height, unsigned int tile_width, unsigned int tile_height,
+                     const std::function<void(int, int, int, int)> &body);
+
+  /**
+   * @brief Reduce the range [\p begin, \p end) in subranges of at most \p grain elements.
+   *
+   * Partial results are combined in the order of the subranges, so the result does not depend on the scheduling.
+   *
+   * @param begin    The first index.
+   * @param end      One past the last index.
+   * @param grain    The maximum number of elements per task.
+   * @param identity The result of an empty range.
+   * @param map      A function returning the result of a subrange, given its begin and end.
+   * @param combine  A function combining two partial results.
+   * @return         The combined result.
+   */
+  template<typename T, typename Map, typename Combine>
+  T parallelReduce(size_t begin, size_t end, size_t grain, T identity, Map map, Combine combine) {
+    if (end <= begin) {
+      return identity;
+    }
+    grain = (grain == 0) ? 1 : grain;
+    const size_t count = (end - begin + grain - 1) / grain;
+    std::vector<T> partial(count, identity);
+    run(count, [&](size_t i) {
+      partial[i] = map(begin + i * grain, std::min(end, begin + (i + 1) * grain));
+    });
+    T result = identity;
+    for (auto &p : partial) {
+      result = combine(result, p);
+    }
+    return result;
+  }
+
+  /// @brief Return the scheduler statistics since construction or the last call to resetStats().
+  Stats stats() const;
+
+  /// @brief Reset the scheduler statistics.
+  void resetStats();
+
+  /// @brief Print the scheduler statistics on some output stream.
+  void report(std::ostream &os = std::cout) const;
+
+ private:
+  /// @brief A group of tasks submitted by one call to run().
+  struct Batch;
+
+  /// @brief A single task: one index of a batch.
+  struct Task {
+    Batch *batch;
+    size_t index;
+  };
+
+  /// @brief A task deque owned by a worker thread.
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  /// @brief The main loop of worker \p id.
+  void work(size_t id);
+
+  /// @brief Take a task from the deque of \p self, or steal one from another deque. Return false if all are empty.
+  bool take(size_t self, Task *task);
+
+  /// @brief Execute a task and signal its batch.
+  void execute(const Task &task);
+
+  /// @brief Push the tasks [\p begin, \p end) of \p batch onto the deques.
+  void push(Batch *batch, size_t begin, size_t end);
+
+  /**
+   * @brief Help executing tasks until \p batch is done, and rethrow the first exception of its tasks.
+   *
+   * If there is nothing to help with, the thread yields for a while, and then sleeps until tasks are pushed or the
+   * last task of the batch completes.
+   */
+  void wait(Batch *batch);
+
+  /// @brief Number of times a waiting thread without tasks to execute yields before it sleeps.
+  static const int spin_limit = 64;
+
+  /// @brief Task deques, one per worker thread.
+  std::vector<std::unique_ptr<Queue>> queues;
+
+  /// @brief Worker threads.
+  std::vector<std::thread> workers;
+
+  /// @brief Number of tasks in all deques.
+  std::atomic<size_t> queued{0};
+
+  /// @brief Deque that the next batch of an external thread is pushed to first.
+  std::atomic<size_t> next_queue{0};
+
+  /// @brief Mutex and condition variable for idle workers, and for threads waiting for a batch.
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  bool stop = false;
+
+  /// @brief Statistics.
+  std::atomic<std::uint64_t> num_tasks{0};
+  std::atomic<std::uint64_t> num_steals{0};
+  std::atomic<std::uint64_t> idle_nanoseconds{0};
+};
@@ -0,0 +1,217 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TiledImage.hpp"
+
+/// @brief Size of the header area at the start of a tiled image file, which is where the first tile starts.
+static const std::uint64_t tiled_header_size = 4096;
+
+TiledImage::~TiledImage() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+std::shared_ptr<TiledImage> TiledImage::create(const std::string &file_name, unsigned int width, unsigned int height,
+                                               unsigned int tile_size) {
+  if ((tile_size == 0) || (tile_size % 32 != 0)) {
+    throw std::domain_error("Tile size must be a non-zero multiple of 32.");
+  }
+  std::shared_ptr<TiledImage> img(new TiledImage());
+  img->width = width;
+  img->height = height;
+  img->tile_size = tile_size;
+  img->writable = true;
+  img->fd = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (img->fd < 0) {
+    throw std::runtime_error("Could not create tiled image " + file_name + ": " + std::strerror(errno));
+  }
+
+  // Size the file without writing the tiles, which leaves them zero and sparse until they are written.
+  TiledImageHeader header{TiledImageHeader::expected_magic, width, height, tile_size};
+  const std::uint64_t size = img->tileOffset(0, img->tilesY());
+  if ((ftruncate(img->fd, (off_t) size) != 0) || (pwrite(img->fd, &header, sizeof(header), 0) != sizeof(header))) {
+    throw std::runtime_error("Could not create tiled image " + file_name + ": " + std::strerror(errno));
+  }
+  return img;
+}
+
+std::shared_ptr<TiledImage> TiledImage::open(const std::string &file_name, bool writable) {
+  std::shared_ptr<TiledImage> img(new TiledImage());
+  img->writable = writable;
+  img->fd = ::open(file_name.c_str(), writable ? O_RDWR : O_RDONLY);
+  struct stat info;
+  if ((img->fd < 0) || (fstat(img->fd, &info) != 0)) {
+    throw std::runtime_error("Could not open tiled image " + file_name + ".");
+  }
+
+  TiledImageHeader header;
+  if ((pread(img->fd, &header, sizeof(header), 0) != sizeof(header))
+      || (header.magic != TiledImageHeader::expected_magic) || (header.tile_size == 0)
+      || (header.tile_size % 32 != 0)) {
+    throw std::runtime_error(file_name + " is not a tiled image.");
+  }
+  img->width = header.width;
+  img->height = header.height;
+  img->tile_size = header.tile_size;
+  if ((std::uint64_t) info.st_size < img->tileOffset(0, img->tilesY())) {
+    throw std::runtime_error("Tiled image " + file_name + " is truncated.");
+  }
+  return img;
+}
+
+std::shared_ptr<TiledImage> TiledImage::fromImage(const Image *img, const std::string &file_name,
+                                                  unsigned int tile_size) {
+  auto tiled = create(file_name, img->width, img->height, tile_size);
+  tiled->writeRegion(Region(0, 0, img->width, img->height), img);
+  return tiled;
+}
+
+std::shared_ptr<TiledImage> TiledImage::fromPAM(const std::string &pam_file, const std::string &file_name,
+                                                unsigned int tile_size) {
+  auto img = Image::fromPAM(pam_file);
+  auto tiled = create(file_name, img->width, img->height, tile_size);
+  for (unsigned int ty = 0; ty < tiled->tilesY(); ty++) {
+    Region r(0, ty * tile_size, img->width, tiled->tile(0, ty).height);
+    tiled->writeRegion(r, ConstImageView(img.get()).sub(r));
+  }
+  return tiled;
+}
+
+void TiledImage::toPAM(const std::string &file_name) const {
+  const std::string header = Image::getPAMHeader(width, height);
+  const std::uint64_t row_bytes = (std::uint64_t) width * sizeof(Pixel);
+  int out = ::open(file_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if ((out < 0) || (ftruncate(out, (off_t) (header.size() + row_bytes * height)) != 0)
+      || (pwrite(out, header.data(), header.size(), 0) != (ssize_t) header.size())) {
+    std::string error = std::strerror(errno);
+    if (out >= 0) {
+      close(out);
+    }
+    throw std::runtime_error("Could not write PAM file " + file_name + ": " + error);
+  }
+
+  // Map the rows of one row of tiles at a time, and read the tiles into them.
+  const std::uint64_t page = (std::uint64_t) sysconf(_SC_PAGESIZE);
+  for (unsigned int ty = 0; ty < tilesY(); ty++) {
+    Region r(0, ty * tile_size, width, tile(0, ty).height);
+    const std::uint64_t offset = header.size() + row_bytes * r.y;
+    const std::uint64_t start = offset - offset % page;
+    const size_t length = (size_t) (offset + row_bytes * r.height - start);
+    void *mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, out, (off_t) start);
+    if (mapping == MAP_FAILED) {
+      std::string error = std::strerror(errno);
+      close(out);
+      throw std::runtime_error("Could not write PAM file " + file_name + ": " + error);
+    }
+    auto *pixels = reinterpret_cast<Pixel *>(static_cast<unsigned char *>(mapping) + (offset - start));
+    readRegion(r, ImageView(pixels, r.width, r.height, (size_t) row_bytes));
+    munmap(mapping, length);
+  }
+  close(out);
+}
+
+bool TiledImage::isTiled(const std::string &file_name) {
+  const std::string extension = ".tiles";
+  return (file_name.size() > extension.size())
+      && (file_name.compare(file_name.size() - extension.size(), extension.size(), extension) == 0);
+}
+
+std::shared_ptr<Image> TiledImage::toImage() const {
+  auto img = std::make_shared<Image>(width, height, Image::Uninitialized());
+  readRegion(Region(0, 0, width, height), img.get());
+  return img;
+}
+
+Region TiledImage::tile(unsigned int tx, unsigned int ty) const {
+  Region r(tx * tile_size, ty * tile_size, 0, 0);
+  r.width = std::min(tile_size, width - r.x);
+  r.height = std::min(tile_size, height - r.y);
+  return r;
+}
+
+std::uint64_t TiledImage::tileOffset(unsigned int tx, unsigned int ty) const {
+  return tiled_header_size + ((std::uint64_t) ty * tilesX() + tx) * tileBytes();
+}
+
+void TiledImage::readRegion(const Region &region, ImageView dest) const {
+  transfer(region, dest, false);
+}
+
+void TiledImage::writeRegion(const Region &region, ConstImageView src) {
+  if (!writable) {
+    throw std::domain_error("Tiled image is not opened for writing.");
+  }
+  // The view is only read when writing.
+  transfer(region, ImageView(const_cast<Pixel *>(src.pixels), src.width, src.height, src.pitch), true);
+}
+
+void TiledImage::transfer(const Region &region, ImageView view, bool write) const {
+  if (!region.within(width, height)) {
+    throw std::domain_error("Region does not lie within the tiled image.");
+  }
+  if ((view.width != region.width) || (view.height != region.height)) {
+    throw std::domain_error("View is not of the size of the region.");
+  }
+  if (region.empty()) {
+    return;
+  }
+
+  // The tiles that a region overlaps in a row of tiles are adjacent in the file, so they are mapped at once.
+  const std::uint64_t page = (std::uint64_t) sysconf(_SC_PAGESIZE);
+  const unsigned int tx0 = region.x / tile_size;
+  const unsigned int tx1 = (region.x + region.width - 1) / tile_size;
+  const unsigned int ty0 = region.y / tile_size;
+  const unsigned int ty1 = (region.y + region.height - 1) / tile_size;
+  for (unsigned int ty = ty0; ty <= ty1; ty++) {
+    const std::uint64_t offset = tileOffset(tx0, ty);
+    const std::uint64_t start = offset - offset % page;
+    const size_t length = (size_t) (tileOffset(tx1 + 1, ty) - start);
+    void *mapping = mmap(nullptr, length, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, (off_t) start);
+    if (mapping == MAP_FAILED) {
+      throw std::runtime_error(std::string("Could not map tiles: ") + std::strerror(errno));
+    }
+    auto *tiles = static_cast<unsigned char *>(mapping) + (offset - start);
+
+    // Copy the rows of the part of the region in every tile.
+    const unsigned int y0 = std::max(region.y, ty * tile_size);
+    const unsigned int y1 = std::min(region.y + region.height, (ty + 1) * tile_size);
+    for (unsigned int tx = tx0; tx <= tx1; tx++) {
+      auto *tile_pixels = reinterpret_cast<Pixel *>(tiles + (size_t) (tx - tx0) * tileBytes());
+      const unsigned int x0 = std::max(region.x, tx * tile_size);
+      const unsigned int x1 = std::min(region.x + region.width, (tx + 1) * tile_size);
+      for (unsigned int y = y0; y < y1; y++) {
+        Pixel *stored = tile_pixels + (size_t) (y - ty * tile_size) * tile_size + (x0 - tx * tile_size);
+        Pixel *pixels = view.row(y - region.y) + (x0 - region.x);
+        if (write) {
+          std::memcpy(stored, pixels, (x1 - x0) * sizeof(Pixel));
+        } else {
+          std::memcpy(pixels, stored, (x1 - x0) * sizeof(Pixel));
+        }
+      }
+    }
+    munmap(mapping, length);
+  }
+}
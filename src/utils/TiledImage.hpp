@@ -0,0 +1,154 @@
+// Copyright 2018 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Image.hpp"
+#include "ImageView.hpp"
+
+/// @brief Header at the start of a tiled image file.
+struct TiledImageHeader {
+  /// @brief Value of magic in a valid file.
+  static const std::uint32_t expected_magic = 0x31544657;  // "WFT1"
+
+  std::uint32_t magic;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t tile_size;
+};
+
+/**
+ * @brief A disk-backed image, stored as square tiles in a file, for images that do not fit in memory.
+ *
+ * The file starts with a TiledImageHeader on its own page, followed by the tiles in row-major tile order. Every tile
+ * holds tile_size x tile_size pixels in row-major order; tiles on the right and bottom edges are stored at full size.
+ * The tile size is a multiple of 32, so every tile starts at a page boundary and rectangular regions are accessed by
+ * mapping only the tiles they overlap. Nothing of the image is held in memory beyond the region being accessed, and
+ * file offsets are 64-bit, so images are limited by disk space rather than by memory or 32-bit pixel indices.
+ *
+ * Distinct regions may be read and written concurrently, as long as no tile is written by more than one thread.
+ */
+struct TiledImage {
+  /// @brief Default width and height of a tile, in pixels.
+  static const unsigned int default_tile_size = 256;
+
+  ~TiledImage();
+
+  TiledImage(const TiledImage &) = delete;
+  TiledImage &operator=(const TiledImage &) = delete;
+
+  /**
+   * @brief Create a tiled image file \p file_name of \p width x \p height, replacing any existing file.
+   *
+   * The file is sized up front without writing it, so its pixels are zero. A runtime error is thrown if the file cannot
+   * be created, and a domain error if \p tile_size is not a non-zero multiple of 32.
+   */
+  static std::shared_ptr<TiledImage> create(const std::string &file_name, unsigned int width, unsigned int height,
+                                            unsigned int tile_size = default_tile_size);
+
+  /**
+   * @brief Open the existing tiled image file \p file_name.
+   *
+   * A runtime error is thrown if the file cannot be opened or is not a tiled image.
+   *
+   * @param file_name The file name.
+   * @param writable  Whether regions of the image may be written.
+   */
+  static std::shared_ptr<TiledImage> open(const std::string &file_name, bool writable = false);
+
+  /// @brief Return a new tiled image file \p file_name holding the pixels of \p img.
+  static std::shared_ptr<TiledImage> fromImage(const Image *img, const std::string &file_name,
+                                               unsigned int tile_size = default_tile_size);
+
+  /**
+   * @brief Return a new tiled image file \p file_name holding the pixels of the PAM file \p pam_file.
+   *
+   * The PAM file is mapped with Image::fromPAM() and copied one row of tiles at a time, so the image is never read into
+   * memory as a whole if its pixels start at a page boundary, as they do in files written by Image::toPAM(). A runtime
+   * error is thrown if either file cannot be accessed.
+   */
+  static std::shared_ptr<TiledImage> fromPAM(const std::string &pam_file, const std::string &file_name,
+                                             unsigned int tile_size = default_tile_size);
+
+  /**
+   * @brief Write the image to a PAM file \p file_name, in the format of Image::toPAM().
+   *
+   * The file is sized up front and written through a mapping of one row of tiles at a time, so the image is never held
+   * in memory as a whole. A runtime error is thrown if the file cannot be written.
+   */
+  void toPAM(const std::string &file_name) const;
+
+  /// @brief Return whether \p file_name has the extension of a tiled image file: .tiles.
+  static bool isTiled(const std::string &file_name);
+
+  /// @brief Return the whole image in memory. Only use this for images that fit in memory.
+  std::shared_ptr<Image> toImage() const;
+
+  /**
+   * @brief Copy the pixels of \p region into \p dest.
+   *
+   * A domain error is thrown if the region does not lie within the image, or if \p dest is not of the size of the
+   * region. A runtime error is thrown if the tiles cannot be mapped.
+   */
+  void readRegion(const Region &region, ImageView dest) const;
+
+  /**
+   * @brief Copy \p src into the pixels of \p region.
+   *
+   * A domain error is thrown if the region does not lie within the image, if \p src is not of the size of the region,
+   * or if the image was not opened for writing. A runtime error is thrown if the tiles cannot be mapped.
+   */
+  void writeRegion(const Region &region, ConstImageView src);
+
+  /// @brief Return the region of tile (\p tx, \p ty), clipped to the image.
+  Region tile(unsigned int tx, unsigned int ty) const;
+
+  /// @brief Return the number of tiles in a row of tiles.
+  inline unsigned int tilesX() const { return (width + tile_size - 1) / tile_size; }
+
+  /// @brief Return the number of tiles in a column of tiles.
+  inline unsigned int tilesY() const { return (height + tile_size - 1) / tile_size; }
+
+  /// @brief Return the size of a tile in bytes.
+  inline std::uint64_t tileBytes() const { return (std::uint64_t) tile_size * tile_size * 4; }
+
+  /// @brief Return the offset of tile (\p tx, \p ty) in the file, in bytes.
+  std::uint64_t tileOffset(unsigned int tx, unsigned int ty) const;
+
+  /// @brief Width of the image.
+  unsigned int width = 0;
+
+  /// @brief Height of the image.
+  unsigned int height = 0;
+
+  /// @brief Width and height of a tile.
+  unsigned int tile_size = default_tile_size;
+
+ private:
+  TiledImage() = default;
+
+  /// @brief Copy between \p region of the file and \p view, in the direction of \p write.
+  void transfer(const Region &region, ImageView view, bool write) const;
+
+  /// @brief File descriptor of the file.
+  int fd = -1;
+
+  /// @brief Whether the file was opened for writing.
+  bool writable = false;
+};